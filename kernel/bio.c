@@ -22,6 +22,7 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 struct {
   struct spinlock lock;
@@ -30,6 +31,9 @@ struct {
   // Linked list of all buffers, through prev/next.
   // head.next is most recently used.
   struct buf head;
+
+  uint hits;
+  uint misses;
 } bcache;
 
 void
@@ -65,7 +69,9 @@ bget(uint dev, uint blockno)
   for(b = bcache.head.next; b != &bcache.head; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
+      bcache.hits++;
       release(&bcache.lock);
+      TRACE(TR_BGET, blockno, 1);
       acquiresleep(&b->lock);
       return b;
     }
@@ -78,7 +84,9 @@ bget(uint dev, uint blockno)
       b->blockno = blockno;
       b->valid = 0;
       b->refcnt = 1;
+      bcache.misses++;
       release(&bcache.lock);
+      TRACE(TR_BGET, blockno, 0);
       acquiresleep(&b->lock);
       return b;
     }
@@ -92,10 +100,14 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
+  struct proc *p;
+
   b = bget(dev, blockno);
   if(!b->valid) {
     virtio_disk_rw(b->dev, b, 0);
     b->valid = 1;
+    if((p = myproc()) != 0)
+      p->inblock++;
   }
   return b;
 }
@@ -104,9 +116,13 @@ bread(uint dev, uint blockno)
 void
 bwrite(struct buf *b)
 {
+  struct proc *p;
+
   if(!holdingsleep(&b->lock))
     panic("bwrite");
   virtio_disk_rw(b->dev, b, 1);
+  if((p = myproc()) != 0)
+    p->oublock++;
 }
 
 // Release a locked buffer.
@@ -148,4 +164,27 @@ bunpin(struct buf *b) {
   release(&bcache.lock);
 }
 
+// Text of /proc/bcache: counts, then the buffers in use.
+int
+bcacheinfo(char *buf, int n)
+{
+  struct buf *b;
+  int len, inuse, valid;
 
+  acquire(&bcache.lock);
+  inuse = valid = 0;
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
+    if(b->refcnt > 0)
+      inuse++;
+    if(b->valid)
+      valid++;
+  }
+  len = snprintf(buf, n, "buffers\t%d\ninuse\t%d\nvalid\t%d\nhits\t%d\nmisses\t%d\n",
+                 NBUF, inuse, valid, bcache.hits, bcache.misses);
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++)
+    if(b->refcnt > 0)
+      len += snprintf(buf+len, n-len, "dev %d block %d refcnt %d\n",
+                      b->dev, b->blockno, b->refcnt);
+  release(&bcache.lock);
+  return len;
+}
@@ -92,6 +92,43 @@ bd_print() {
   }
 }
 
+// Number of blocks on the free list of size k.
+// Caller must hold lock.
+static int
+bd_nfreeblk(int k) {
+  struct list *p;
+  int n = 0;
+
+  for (p = bd_sizes[k].free.next; p != &bd_sizes[k].free; p = p->next)
+    n++;
+  return n;
+}
+
+// Bytes on the free lists.
+uint64
+bd_nfree() {
+  uint64 n = 0;
+
+  acquire(&lock);
+  for (int k = 0; k < nsizes; k++)
+    n += bd_nfreeblk(k) * BLK_SIZE(k);
+  release(&lock);
+  return n;
+}
+
+// Text of /proc/buddyinfo: the free blocks of each size.
+int
+buddyinfo(char *buf, int n) {
+  int len;
+
+  len = snprintf(buf, n, "size\tblksz\tfree\n");
+  acquire(&lock);
+  for (int k = 0; k < nsizes; k++)
+    len += snprintf(buf+len, n-len, "%d\t%d\t%d\n", k, (int)BLK_SIZE(k), bd_nfreeblk(k));
+  release(&lock);
+  return len;
+}
+
 // What is the first k such that 2^k >= n?
 int
 firstk(uint64 n) {
@@ -32,7 +32,8 @@
 void
 consputc(int c)
 {
-  extern volatile int panicked; // from printf.c
+  extern volatile int panicked, panicking; // from printf.c
+  void (*putc)(int) = panicking ? uartputc_sync : uartputc;
 
   if(panicked){
     for(;;)
@@ -41,9 +42,9 @@ consputc(int c)
 
   if(c == BACKSPACE){
     // if the user typed backspace, overwrite with a space.
-    uartputc('\b'); uartputc(' '); uartputc('\b');
+    putc('\b'); putc(' '); putc('\b');
   } else {
-    uartputc(c);
+    putc(c);
   }
 }
 
@@ -56,6 +57,12 @@ struct cons_t {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+
+  // output: writes are staged here, a chunk at a time,
+  // and handed to the uart in one piece.
+  struct sleeplock wlock; // protects obuf
+#define OUTPUT_BUF PGSIZE
+  char obuf[OUTPUT_BUF];
 } consoles[NBCONSOLES];
 
 struct spinlock console_number_lock;
@@ -68,7 +75,7 @@ struct cons_t* cons;
 int
 consolewrite(struct file *f, int user_src, uint64 src, int n)
 {
-  int i;
+  int tot, m;
 
   struct cons_t* cons = &consoles[f->minor-1];
   acquire(&console_number_lock);
@@ -76,18 +83,17 @@ consolewrite(struct file *f, int user_src, uint64 src, int n)
     sleep(cons, &console_number_lock);
   }
   release(&console_number_lock);
-  char* buf = bd_malloc(n);
-  for(i = 0; i < n; i++){
-    if(either_copyin(&buf[i], user_src, src+i, 1) == -1)
+  acquiresleep(&cons->wlock);
+  for(tot = 0; tot < n; tot += m){
+    m = n - tot;
+    if(m > OUTPUT_BUF)
+      m = OUTPUT_BUF;
+    if(either_copyin(cons->obuf, user_src, src+tot, m) == -1)
       break;
+    uartwrite(cons->obuf, m);
   }
-  acquire(&cons->lock);
-  for(int j = 0; j < i; j++){
-    consputc(buf[j]);
-  }
-  release(&cons->lock);
-  bd_free(buf);
-  return n;
+  releasesleep(&cons->wlock);
+  return tot;
 }
 
 //
@@ -100,7 +106,8 @@ int
 consoleread(struct file *f, int user_dst, uint64 dst, int n)
 {
   uint target;
-  int c;
+  int c, len, done;
+  char buf[INPUT_BUF];
 
   target = n;
   struct cons_t* cons = &consoles[f->minor-1];
@@ -109,44 +116,53 @@ consoleread(struct file *f, int user_dst, uint64 dst, int n)
     sleep(cons, &console_number_lock);
   }
   release(&console_number_lock);
-  int len = 0;
-  char* buf = bd_malloc(n);
-  acquire(&cons->lock);
-  while(n > 0){
-    // wait until interrupt handler has put some
-    // input into cons->buffer.
-    while(cons->r == cons->w){
-      if(myproc()->killed){
-        release(&cons->lock);
-        return -1;
+  done = 0;
+  while(n > 0 && !done){
+    // collect what we can into buf, then copy it out
+    // with cons->lock released.
+    len = 0;
+    acquire(&cons->lock);
+    while(n > 0 && len < sizeof(buf)){
+      // wait until interrupt handler has put some
+      // input into cons->buffer.
+      while(len == 0 && cons->r == cons->w){
+        if(myproc()->killed){
+          release(&cons->lock);
+          return -1;
+        }
+        sleep(&cons->r, &cons->lock);
       }
-      sleep(&cons->r, &cons->lock);
-    }
-
-    c = cons->buf[cons->r++ % INPUT_BUF];
-
-    if(c == C('D')){  // end-of-file
-      if(n < target){
-        // Save ^D for next time, to make sure
-        // caller gets a 0-byte result.
-        cons->r--;
+      if(cons->r == cons->w)
+        break;
+
+      c = cons->buf[cons->r++ % INPUT_BUF];
+
+      if(c == C('D')){  // end-of-file
+        if(n < target){
+          // Save ^D for next time, to make sure
+          // caller gets a 0-byte result.
+          cons->r--;
+        }
+        done = 1;
+        break;
       }
-      break;
-    }
 
-    // copy the input byte to the user-space buffer.
-    buf[len++] = c;
-    --n;
+      // copy the input byte to the user-space buffer.
+      buf[len++] = c;
+      --n;
 
-    if(c == '\n'){
-      // a whole line has arrived, return to
-      // the user-level read().
-      break;
+      if(c == '\n'){
+        // a whole line has arrived, return to
+        // the user-level read().
+        done = 1;
+        break;
+      }
     }
+    release(&cons->lock);
+    if(either_copyout(user_dst, dst, buf, len) == -1)
+      return -1;
+    dst += len;
   }
-  release(&cons->lock);
-  either_copyout(user_dst, dst, buf, len);
-  bd_free(buf);
   return target - n;
 }
 
@@ -226,6 +242,7 @@ consoleinit(void)
   cons = &consoles[console_number];
   for(int i = 0; i < NBCONSOLES; i++){
     initlock(&consoles[i].lock, "cons");
+    initsleeplock(&consoles[i].wlock, "conswrite");
   }
 
   uartinit();
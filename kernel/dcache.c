@@ -0,0 +1,192 @@
+// Directory entry cache.
+//
+// The dcache remembers the result of recent directory lookups,
+// keyed by (dev, directory inum, name), so that namex() can walk
+// a path without reading directory blocks or taking the
+// directories' sleep-locks. An entry with inum 0 is a negative
+// entry: it records that the name is absent from the directory.
+//
+// Entries are only created for directories, while the directory
+// is locked (dirlookup, dirlink), and are updated by the code
+// that changes a directory (dirlink, dirunlink), also with the
+// directory locked. When a directory inode is freed, iput()
+// purges every entry recorded under it, so a recycled inum never
+// inherits stale names.
+//
+// dcache.lock protects everything here. dcache_get() takes the
+// reference on the target inode while still holding it, so an
+// unlink that invalidates the entry either happens before the
+// lookup (which then misses) or finds the inode referenced.
+// Lock order: dcache.lock, then the icache locks.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NDCHASH 61
+
+struct dcentry {
+  uint dev;
+  uint dinum;            // directory holding the name; 0 if entry unused
+  uint inum;             // inode the name refers to; 0 if negative
+  char name[DIRSIZ];
+  struct dcentry *hnext; // hash chain
+  struct dcentry *prev;  // LRU list
+  struct dcentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct dcentry entry[NDCACHE];
+  struct dcentry *hash[NDCHASH];
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recently used.
+  struct dcentry head;
+
+  uint hits;
+  uint misses;
+} dcache;
+
+void
+dcacheinit(void)
+{
+  struct dcentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.entry; d < dcache.entry+NDCACHE; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+static uint
+dchash(uint dev, uint dinum, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dinum;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 33 + (uchar)name[i];
+  return h % NDCHASH;
+}
+
+// Move d to the head of the LRU list.
+static void
+dctouch(struct dcentry *d)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->next = dcache.head.next;
+  d->prev = &dcache.head;
+  dcache.head.next->prev = d;
+  dcache.head.next = d;
+}
+
+static void
+dcunhash(struct dcentry *d)
+{
+  struct dcentry **pp;
+
+  for(pp = &dcache.hash[dchash(d->dev, d->dinum, d->name)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == d){
+      *pp = d->hnext;
+      break;
+    }
+  }
+  d->hnext = 0;
+  d->dinum = 0;
+}
+
+// Caller must hold dcache.lock.
+static struct dcentry*
+dcfind(uint dev, uint dinum, char *name)
+{
+  struct dcentry *d;
+
+  for(d = dcache.hash[dchash(dev, dinum, name)]; d; d = d->hnext){
+    if(d->dev == dev && d->dinum == dinum && namecmp(name, d->name) == 0)
+      return d;
+  }
+  return 0;
+}
+
+// Look up name in directory (dev, dinum).
+// Returns 0 on a miss. On a hit returns 1 and sets *ipp to the
+// referenced (but unlocked) inode, or to 0 for a negative entry.
+int
+dcache_get(uint dev, uint dinum, char *name, struct inode **ipp)
+{
+  struct dcentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dinum, name)) == 0){
+    dcache.misses++;
+    release(&dcache.lock);
+    return 0;
+  }
+  dcache.hits++;
+  dctouch(d);
+  *ipp = d->inum ? iget(dev, d->inum) : 0;
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in directory (dev, dinum) refers to inum,
+// or is absent if inum is 0. Caller must hold the directory's lock.
+void
+dcache_put(uint dev, uint dinum, char *name, uint inum)
+{
+  struct dcentry *d;
+  uint h;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dinum, name)) == 0){
+    // Recycle the least recently used entry.
+    d = dcache.head.prev;
+    if(d->dinum)
+      dcunhash(d);
+    d->dev = dev;
+    d->dinum = dinum;
+    strncpy(d->name, name, DIRSIZ);
+    h = dchash(dev, dinum, name);
+    d->hnext = dcache.hash[h];
+    dcache.hash[h] = d;
+  }
+  d->inum = inum;
+  dctouch(d);
+  release(&dcache.lock);
+}
+
+// Forget every entry recorded under directory (dev, dinum).
+// Called when the directory's inode is freed.
+void
+dcache_purge(uint dev, uint dinum)
+{
+  struct dcentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.entry; d < dcache.entry+NDCACHE; d++){
+    if(d->dinum == dinum && d->dev == dev){
+      dcunhash(d);
+      // Move to the tail so it is recycled first.
+      d->next->prev = d->prev;
+      d->prev->next = d->next;
+      d->prev = dcache.head.prev;
+      d->next = &dcache.head;
+      dcache.head.prev->next = d;
+      dcache.head.prev = d;
+    }
+  }
+  release(&dcache.lock);
+}
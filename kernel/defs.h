@@ -15,6 +15,7 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct vdsotime;
 
 // bio.c
 void            binit(void);
@@ -23,12 +24,41 @@ void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bcacheinfo(char*, int);
 
 // console.c
 void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
 
+// klog.c
+void            kloginit(void);
+void            klogstart(void);
+void            klogputc(int);
+void            klogflush(void);
+
+// prof.c
+void            profinit(void);
+int             profintr(void);
+
+// trace.c
+extern int      traceon;
+void            traceinit(void);
+void            trace(int, uint64, uint64);
+#define TRACE(ev, a, b)  do { if(traceon) trace((ev), (a), (b)); } while(0)
+
+// textcache.c
+void            textinit(void);
+char*           textpage(struct inode*, uint, uint, int*);
+void            textpurge(struct inode*);
+int             textreclaim(void);
+
+// dcache.c
+void            dcacheinit(void);
+int             dcache_get(uint, uint, char*, struct inode**);
+void            dcache_put(uint, uint, char*, uint);
+void            dcache_purge(uint, uint);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -45,14 +75,21 @@ int             filewrite(struct file*, uint64, int n);
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+int             dirstats(struct inode*, uint*, uint64, int);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iget(uint, uint);
+void            iflush(struct inode*, int);
+void            iflushall(void);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
+int             ireclaim(void);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
+int             iwbuffer(struct inode*, uint64, uint, int);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
@@ -68,7 +105,10 @@ void            ramdiskrw(struct buf*);
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+void            kdup(void *);
+int             krefs(void *);
 void            kinit();
+int             meminfo(char*, int);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -86,8 +126,8 @@ int             pipewrite(struct pipe*, uint64, int);
 // printf.c
 void            printf(char*, ...);
 void            printf_no_lock(char*, ...);
+int             snprintf(char*, int, char*, ...);
 void            panic(char*) __attribute__((noreturn));
-void            printfinit(void);
 
 // proc.c
 int             cpuid(void);
@@ -96,8 +136,12 @@ int             fork(void);
 int             nice(int,int);
 int             growproc(long);
 pagetable_t     proc_pagetable(struct proc *);
-void            proc_freepagetable(pagetable_t, uint64);
+int             proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             proc_sccount(int, uint64*, uint64*);
+int             procinfo(uint64, int);
+int             kthread(char*, void (*)(void*), void*);
+int             spawn(char*, struct file**);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -116,6 +160,21 @@ void            procdump(void);
 void            priodump(void);
 void            proc_vmprint(struct proc* p);
 void            proc_vmprint_by_pid(int pid);
+int             procpid(int);
+int             procstatus(int, char*, int);
+int             procmaps(int, char*, int);
+int             procpagetable(int, char*, int);
+
+// procfs.c
+char*           procfspath(char*);
+struct file*    procfsopen(char*, int);
+int             procfsread(struct file*, uint64, int);
+int             procfsstat(struct file*, uint64);
+int             procfsgetdents(struct file*, uint64, int);
+void            procfsclose(struct file*);
+// start.c
+void            timerinterval(int);
+
 // swtch.S
 void            swtch(struct context*, struct context*);
 
@@ -123,16 +182,19 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initlock_unlisted(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 uint64          sys_ntas(void);
+int             lockinfo(char*, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            initsleeplock_unlisted(struct sleeplock*, char*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -160,10 +222,17 @@ void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
 
+// vdso.c
+extern struct vdsotime *vdsotime;
+void            vdsoinit(void);
+void            vdsotick(void);
+
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
+void            uartputc_sync(int);
+void            uartwrite(char*, int);
 int             uartgetc(void);
 
 // vm.c
@@ -177,14 +246,15 @@ void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
-void            uvmfree(pagetable_t, uint64);
-void            uvmunmap(pagetable_t, uint64, uint64, int);
+int             uvmfree(pagetable_t, uint64);
+int             uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 void            vmprint(pagetable_t pt, uint64 pid, char* cmd);
+int             vmsprint(pagetable_t, char*, int);
 // plic.c
 void            plicinit(void);
 void            plicinithart(void);
@@ -192,6 +262,8 @@ int             plic_claim(void);
 void            plic_complete(int);
 
 int do_allocate(pagetable_t pagetable, struct proc*, uint64 addr, uint64 scause);
+int do_prefault(pagetable_t pagetable, struct proc*, uint64 addr);
+int do_allocate_range(pagetable_t pagetable, struct proc*, uint64 addr, uint64 len, uint64 scause);
 
 // virtio_disk.c
 void            virtio_disk_init(int);
@@ -208,6 +280,8 @@ void            virtio_disk_intr(int);
 void           bd_init(void*,void*);
 void           bd_free(void*);
 void           *bd_malloc(uint64);
+uint64         bd_nfree(void);
+int            buddyinfo(char*, int);
 
 struct list {
   struct list *next;
@@ -3,6 +3,9 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
@@ -13,11 +16,11 @@ int exec(char *path, char **argv)
 {
   struct vma *vma_stack;
   struct vma *vma_heap;
-  struct vma *pvmas;
+  struct vma *pvmas, *newvmas;
 
-  char *s, *last;
-  int i, off;
-  uint64 argc, sz, sp, ustack[MAXARG + 1], stackbase;
+  char *s, *last, *stk = 0;
+  int i, off, n;
+  uint64 argc, sz, sp, ustack[MAXARG + 1], stackbase, wsmap, va;
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
@@ -39,10 +42,13 @@ int exec(char *path, char **argv)
   ilock(ip);
 
   uint64 oldsz = max_addr_in_memory_areas(p);
-  // réinitialisation des champs
+  // réinitialisation des champs, sous vma_lock pour les lecteurs
+  // de /proc/<pid>/maps
+  acquire(&p->vma_lock);
   p->stack_vma = 0;
   p->heap_vma = 0;
   p->memory_areas = 0;
+  release(&p->vma_lock);
 
   // Check ELF header
   if (readi(ip, 0, (uint64)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -68,6 +74,7 @@ int exec(char *path, char **argv)
     if (readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
     {
       printf("exec: program header error\n");
+      goto bad;
     }
     if (ph.type != ELF_PROG_LOAD)
       continue;
@@ -93,10 +100,16 @@ int exec(char *path, char **argv)
     }
     sz = max_addr_in_memory_areas(p);
     struct vma * vma_segment = add_memory_area(p, PGROUNDDOWN(ph.vaddr), PGROUNDUP(ph.vaddr + ph.memsz));
-    vma_segment->file = path;
+    vma_segment->ip = idup(ip);
     vma_segment->file_offset = ph.off;
     vma_segment->file_nbytes = ph.filesz;
-    vma_segment->vma_flags = VMA_R | VMA_W | VMA_X;
+    vma_segment->vma_flags = 0;
+    if (ph.flags & ELF_PROG_FLAG_READ)
+      vma_segment->vma_flags |= VMA_R;
+    if (ph.flags & ELF_PROG_FLAG_WRITE)
+      vma_segment->vma_flags |= VMA_W;
+    if (ph.flags & ELF_PROG_FLAG_EXEC)
+      vma_segment->vma_flags |= VMA_X;
 
     // if (loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
     // {
@@ -104,12 +117,19 @@ int exec(char *path, char **argv)
     //   goto bad;
     // }
   }
+  wsmap = ip->wsmap;
   iunlockput(ip);
   end_op(ROOTDEV);
   ip = 0;
 
   p = myproc();
 
+  // Map the pages the program touched at startup the last time
+  // it ran, rather than taking a page fault for each.
+  for (va = 0; wsmap; va += PGSIZE, wsmap >>= 1)
+    if (wsmap & 1)
+      do_prefault(pagetable, p, va);
+
   // Allocate two pages at the next page boundary.
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
@@ -119,14 +139,23 @@ int exec(char *path, char **argv)
   //   goto bad;
   // }
   // uvmclear(pagetable, sz - 2 * PGSIZE);
-  sp = USTACK_TOP;
-  stackbase = USTACK_BOTTOM;
   p->stack_vma = add_memory_area(p, USTACK_BOTTOM, USTACK_TOP);
   p->stack_vma->vma_flags = VMA_R | VMA_W; // Ajout des permissions requises
 
   p->heap_vma = add_memory_area(p, sz, sz);
   p->heap_vma->vma_flags = VMA_R | VMA_W; // Ajout des permissions requises
 
+  // Build the top page of the new stack in place: the argument
+  // strings, then the argv[] array below them. It is mapped
+  // into the new page table as is, with no copyout.
+  if ((stk = kalloc()) == 0)
+  {
+    printf("exec: kalloc failed for the stack\n");
+    goto bad;
+  }
+  sp = USTACK_TOP;
+  stackbase = USTACK_TOP - PGSIZE;
+
   // Push argument strings, prepare rest of stack in ustack.
   for (argc = 0; argv[argc]; argc++)
   {
@@ -135,18 +164,15 @@ int exec(char *path, char **argv)
       printf("exec: too many args\n");
       goto bad;
     }
-    sp -= strlen(argv[argc]) + 1;
+    n = strlen(argv[argc]) + 1;
+    sp -= n;
     sp -= sp % 16; // riscv sp must be 16-byte aligned
     if (sp < stackbase)
     {
       printf("exec: sp < stackbase\n");
       goto bad;
     }
-    if (copyout(pagetable, sp, argv[argc], strlen(argv[argc]) + 1) < 0)
-    {
-      printf("exec: copy argument strings failed\n");
-      goto bad;
-    }
+    memmove(stk + (sp - stackbase), argv[argc], n);
     ustack[argc] = sp;
   }
   ustack[argc] = 0;
@@ -159,11 +185,15 @@ int exec(char *path, char **argv)
     printf("exec: sp < stackbase, le retour\n");
     goto bad;
   }
-  if (copyout(pagetable, sp, (char *)ustack, (argc + 1) * sizeof(uint64)) < 0)
+  memmove(stk + (sp - stackbase), ustack, (argc + 1) * sizeof(uint64));
+
+  if (mappages(pagetable, stackbase, PGSIZE, (uint64)stk, PTE_R | PTE_W | PTE_U) != 0)
   {
-    printf("exec: copy argument pointers failed\n");
+    printf("exec: mapping the stack failed\n");
     goto bad;
   }
+  stk = 0; // now freed with the page table
+  p->rss++;
 
   // arguments to user main(argc, argv)
   // argc is returned via the system call return
@@ -180,28 +210,47 @@ int exec(char *path, char **argv)
     bd_free(p->cmd);
   p->cmd = strjoin(argv);
 
-  // Commit to the user image.
+  // Commit to the user image. Readers of p->pagetable other
+  // than p itself (procpagetable) hold vma_lock, so once it is
+  // released no one can be walking the old page table.
+  acquire(&p->vma_lock);
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
+  release(&p->vma_lock);
   // p->sz = sz;
   p->tf->epc = elf.entry; // initial program counter = main
   p->tf->sp = sp;         // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  p->exectick = ticks;
+  // p->rss counted the new image's pages as they were mapped.
+  p->rss -= proc_freepagetable(oldpagetable, oldsz);
+  begin_op(ROOTDEV);
+  vma_iput(pvmas);
+  end_op(ROOTDEV);
   free_vma(pvmas);
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
 bad:
+  if (stk)
+    kfree(stk);
   if (pagetable)
-    proc_freepagetable(pagetable, max_addr_in_memory_areas(p));
+    p->rss -= proc_freepagetable(pagetable, max_addr_in_memory_areas(p));
   if (ip)
   {
     iunlockput(ip);
     end_op(ROOTDEV);
   }
-  // réinitialisation des champs
+  // réinitialisation des champs, sous vma_lock, puis libération
+  // des VMAs du nouveau programme
+  acquire(&p->vma_lock);
+  newvmas = p->memory_areas;
   p->stack_vma = vma_stack;
   p->heap_vma = vma_heap;
   p->memory_areas = pvmas;
+  release(&p->vma_lock);
+  begin_op(ROOTDEV);
+  vma_iput(newvmas);
+  end_op(ROOTDEV);
+  free_vma(newvmas);
 
   return -1;
 }
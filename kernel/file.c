@@ -79,6 +79,8 @@ fileclose(struct file *f)
     begin_op(ff.ip->dev);
     iput(ff.ip);
     end_op(ff.ip->dev);
+  } else if(ff.type == FD_PROC){
+    procfsclose(&ff);
   }
 }
 
@@ -98,6 +100,8 @@ filestat(struct file *f, uint64 addr)
       return -1;
     return 0;
   }
+  if(f->type == FD_PROC)
+    return procfsstat(f, addr);
   return -1;
 }
 
@@ -122,6 +126,8 @@ fileread(struct file *f, uint64 addr, int n)
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
+  } else if(f->type == FD_PROC){
+    r = procfsread(f, addr, n);
   } else {
     panic("fileread");
   }
@@ -146,9 +152,25 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(f, 1, addr, n);
   } else if(f->type == FD_INODE){
+    // small appends are buffered in the inode and
+    // written back later (see iwbuffer in fs.c).
+    ilock(f->ip);
+    r = iwbuffer(f->ip, addr, f->off, n);
+    if(r == 0 && f->ip->wblen > 0){
+      iunlock(f->ip);
+      iflush(f->ip, 0);
+      ilock(f->ip);
+      r = iwbuffer(f->ip, addr, f->off, n);
+    }
+    if(r > 0)
+      f->off += r;
+    iunlock(f->ip);
+    if(r != 0)
+      return r;
+
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
+    // i-node, index blocks, allocation blocks,
     // and 2 blocks of slop for non-aligned writes.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
@@ -161,6 +183,13 @@ filewrite(struct file *f, uint64 addr, int n)
 
       begin_op(f->ip->dev);
       ilock(f->ip);
+      if(f->ip->wblen > 0){
+        // buffered appends must reach the disk first.
+        iunlock(f->ip);
+        end_op(f->ip->dev);
+        iflush(f->ip, 0);
+        continue;
+      }
       if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
@@ -2,15 +2,21 @@
 #define FILE_H
 
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_PROC } type;
   int ref; // reference count
   char readable;
   char writable;
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
-  uint off;          // FD_INODE and FD_DEVICE
+  uint off;          // FD_INODE, FD_DEVICE and FD_PROC
   short major;       // FD_DEVICE
   short minor;       // FD_DEVICE
+  int pid;           // FD_PROC: process, or 0 (see procfs.c)
+  int pfile;         // FD_PROC: which file, or -1 for a directory
+  struct sleeplock plock; // FD_PROC: protects off and the three below
+  char *pbuf;        // FD_PROC: text, made by reading at offset 0
+  uint plen;         // FD_PROC: length of the text
+  uint psize;        // FD_PROC: size of pbuf
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
@@ -22,6 +28,9 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext;  // icache hash chain
+  struct inode *lprev;  // icache LRU list, while ref is 0
+  struct inode *lnext;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -30,7 +39,12 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NADDRS];
+
+  char *wbuf;         // delayed appends (see iwbuffer)
+  uint wblen;         // bytes pending in wbuf
+  char text;          // has pages in the text cache
+  uint64 wsmap;       // user pages touched at startup when run (see exec)
 };
 
 // map major device number to device functions.
@@ -44,5 +58,8 @@ extern struct devsw devsw[];
 #define DISK 0
 #define CONSOLE 1
 #define WATCHDOG 2
+#define DMESG 3
+#define PROF 4
+#define KTRACE 5
 
 #endif
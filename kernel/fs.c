@@ -38,13 +38,33 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+// In-memory free-space summary, built from the bitmap at
+// fsinit and kept in step by balloc and bfree. The bitmap
+// blocks, read and written through the log, remain the truth;
+// the counts only let balloc skip full bitmap blocks.
+struct {
+  struct spinlock lock;
+  uint cursor;    // where an allocation without a hint starts
+  uint nfree;     // free blocks on the disk
+  uint ngroups;   // bitmap blocks
+  uint *gfree;    // free blocks covered by each bitmap block
+} fsfree;
+
+static void fsfreeinit(int);
+static void flusher(void*);
+
 // Init fs
 void
 fsinit(int dev) {
   readsb(dev, &sb);
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
+  if(sb.bsize != BSIZE)
+    panic("file system block size mismatch");
   initlog(dev, &sb);
+  fsfreeinit(dev);
+  if(kthread("flusher", flusher, 0) < 0)
+    panic("fsinit: flusher");
 }
 
 // Zero a block.
@@ -61,25 +81,85 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Count the free blocks described by each bitmap block.
+static void
+fsfreeinit(int dev)
+{
+  struct buf *bp;
+  uint g, b, bi;
+
+  initlock(&fsfree.lock, "fsfree");
+  fsfree.ngroups = (sb.size + BPB - 1) / BPB;
+  fsfree.gfree = bd_malloc(fsfree.ngroups * sizeof(uint));
+  if(fsfree.gfree == 0)
+    panic("fsfreeinit");
+  fsfree.nfree = 0;
+  for(g = 0; g < fsfree.ngroups; g++){
+    fsfree.gfree[g] = 0;
+    bp = bread(dev, sb.bmapstart + g);
+    for(bi = 0, b = g*BPB; bi < BPB && b < sb.size; bi++, b++)
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        fsfree.gfree[g]++;
+    brelse(bp);
+    fsfree.nfree += fsfree.gfree[g];
+  }
+  fsfree.cursor = 0;
+}
+
+// Allocate a disk block, preferring the first free block after
+// hint (typically the block that precedes it in the file) so
+// that files are laid out in contiguous runs. Without a hint
+// the search starts at a rotating cursor rather than block 0.
+// The bitmap is scanned a 64-bit word at a time and bitmap
+// blocks with no free bits are skipped. The block is zeroed
+// unless zero is 0, meaning the caller will overwrite all of it.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint hint, int zero)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint64 *map, word;
+  uint start, g, g0, i, w, bi, b;
+
+  acquire(&fsfree.lock);
+  if(fsfree.nfree == 0)
+    panic("balloc: out of blocks");
+  start = (hint && hint + 1 < sb.size) ? hint + 1 : fsfree.cursor;
+  release(&fsfree.lock);
+
+  // Visit every bitmap block, starting with the one holding
+  // start; visit that one again at the end for the words
+  // before start.
+  g0 = start / BPB;
+  for(i = 0; i <= fsfree.ngroups; i++){
+    g = (g0 + i) % fsfree.ngroups;
+    if(fsfree.gfree[g] == 0)
+      continue;
+    bp = bread(dev, sb.bmapstart + g);
+    map = (uint64*)bp->data;
+    for(w = (i == 0) ? (start % BPB) / 64 : 0; w < BPB/64; w++){
+      word = map[w];
+      if(i == 0 && w == (start % BPB) / 64)
+        word |= (1UL << (start % 64)) - 1;  // bits before start
+      if(word == ~0UL)
+        continue;
+      for(bi = 0; word & (1UL << bi); bi++)
+        ;
+      b = g*BPB + w*64 + bi;
+      if(b >= sb.size)
+        break;
+      map[w] |= 1UL << bi;  // Mark block in use.
+      log_write(bp);
+      brelse(bp);
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+      acquire(&fsfree.lock);
+      fsfree.nfree--;
+      fsfree.gfree[g]--;
+      fsfree.cursor = b + 1 < sb.size ? b + 1 : 0;
+      release(&fsfree.lock);
+
+      if(zero)
+        bzero(dev, b);
+      return b;
     }
     brelse(bp);
   }
@@ -101,6 +181,11 @@ bfree(int dev, uint b)
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
+
+  acquire(&fsfree.lock);
+  fsfree.nfree++;
+  fsfree.gfree[b / BPB]++;
+  release(&fsfree.lock);
 }
 
 // Inodes.
@@ -163,32 +248,67 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// The cache is a hash table keyed by (dev, inum). Each bucket
+// has a spin-lock that protects the chain and, for the inodes
+// on it, ip->ref, ip->dev and ip->inum; one must hold the
+// bucket lock while using any of those fields. Inodes with
+// ip->ref == 0 stay cached, still valid so that ilock() need
+// not read them again, on an LRU list protected by
+// icache.lrulock. iget() allocates cache entries with
+// bd_malloc() until there are NINODE of them, and after that
+// reuses the least recently used unreferenced one; ireclaim()
+// frees every unreferenced one when memory runs short.
+// Lock order: bucket lock, then icache.lrulock. Inode locks
+// are not entered in the lock table (see initlock_unlisted),
+// which has room for only NLOCK.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
-struct {
+#define NIHASH 31
+
+struct ibucket {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *head;
+};
+
+struct {
+  struct ibucket bucket[NIHASH];
+
+  struct spinlock lrulock;
+  // Unreferenced inodes, through lprev/lnext.
+  // lru.lnext is most recently used.
+  struct inode lru;
+  int n;               // cache entries allocated
 } icache;
 
 void
 iinit()
 {
-  int i = 0;
-  
-  initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  int i;
+
+  for(i = 0; i < NIHASH; i++)
+    initlock(&icache.bucket[i].lock, "icache");
+  initlock(&icache.lrulock, "icache.lru");
+  icache.lru.lprev = &icache.lru;
+  icache.lru.lnext = &icache.lru;
 }
 
-static struct inode* iget(uint dev, uint inum);
+static struct ibucket*
+ibucket(uint dev, uint inum)
+{
+  return &icache.bucket[(dev * 31 + inum) % NIHASH];
+}
+
+// Caller must hold icache.lrulock.
+static void
+lruremove(struct inode *ip)
+{
+  ip->lnext->lprev = ip->lprev;
+  ip->lprev->lnext = ip->lnext;
+  ip->lprev = ip->lnext = 0;
+}
 
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -237,50 +357,156 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
-// Find the inode with number inum on device dev
-// and return the in-memory copy. Does not lock
-// the inode and does not read it from disk.
+// Take the least recently used unreferenced inode out of the
+// cache and return it, or return 0 if there is none.
 static struct inode*
-iget(uint dev, uint inum)
+ievict(void)
 {
-  struct inode *ip, *empty;
-
-  acquire(&icache.lock);
-
-  // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&icache.lock);
+  struct ibucket *b;
+  struct inode *ip, **pp;
+  uint dev, inum;
+
+  for(;;){
+    acquire(&icache.lrulock);
+    ip = icache.lru.lprev;
+    if(ip == &icache.lru){
+      release(&icache.lrulock);
+      return 0;
+    }
+    dev = ip->dev;
+    inum = ip->inum;
+    release(&icache.lrulock);
+
+    // Look the victim up again with its bucket locked, since
+    // it may have been referenced or evicted in the meantime.
+    b = ibucket(dev, inum);
+    acquire(&b->lock);
+    for(ip = b->head; ip; ip = ip->hnext)
+      if(ip->dev == dev && ip->inum == inum)
+        break;
+    if(ip && ip->ref == 0){
+      for(pp = &b->head; *pp != ip; pp = &(*pp)->hnext)
+        ;
+      *pp = ip->hnext;
+      acquire(&icache.lrulock);
+      lruremove(ip);
+      release(&icache.lrulock);
+      release(&b->lock);
+      textpurge(ip);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+    release(&b->lock);
   }
+}
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+static void
+ifree(struct inode *ip)
+{
+  bd_free(ip);
+  acquire(&icache.lrulock);
+  icache.n--;
+  release(&icache.lrulock);
+}
+
+// Free every unreferenced cached inode.
+// Returns the number freed.
+int
+ireclaim(void)
+{
+  struct inode *ip;
+  int n;
 
-  ip = empty;
-  ip->dev = dev;
-  ip->inum = inum;
-  ip->ref = 1;
-  ip->valid = 0;
-  release(&icache.lock);
+  for(n = 0; (ip = ievict()) != 0; n++)
+    ifree(ip);
+  return n;
+}
 
+// Return an unused cache entry, allocating a new one while
+// the cache is smaller than NINODE.
+static struct inode*
+inew(void)
+{
+  struct inode *ip;
+  int n;
+
+  acquire(&icache.lrulock);
+  n = icache.n;
+  release(&icache.lrulock);
+
+  if(n >= NINODE && (ip = ievict()) != 0)
+    return ip;
+  if((ip = bd_malloc(sizeof(*ip))) == 0){
+    if((ip = ievict()) == 0)
+      panic("iget: no inodes");
+    return ip;
+  }
+  memset(ip, 0, sizeof(*ip));
+  initsleeplock_unlisted(&ip->lock, "inode");
+  acquire(&icache.lrulock);
+  icache.n++;
+  release(&icache.lrulock);
   return ip;
 }
 
+// Find the inode with number inum on device dev
+// and return the in-memory copy. Does not lock
+// the inode and does not read it from disk.
+struct inode*
+iget(uint dev, uint inum)
+{
+  struct ibucket *b;
+  struct inode *ip, *fresh;
+
+  b = ibucket(dev, inum);
+  fresh = 0;
+  for(;;){
+    acquire(&b->lock);
+
+    // Is the inode already cached?
+    for(ip = b->head; ip; ip = ip->hnext){
+      if(ip->dev == dev && ip->inum == inum){
+        if(ip->ref == 0){
+          acquire(&icache.lrulock);
+          lruremove(ip);
+          release(&icache.lrulock);
+        }
+        ip->ref++;
+        release(&b->lock);
+        if(fresh)
+          ifree(fresh);
+        return ip;
+      }
+    }
+
+    if(fresh){
+      fresh->dev = dev;
+      fresh->inum = inum;
+      fresh->ref = 1;
+      fresh->valid = 0;
+      fresh->wsmap = 0;
+      fresh->hnext = b->head;
+      b->head = fresh;
+      release(&b->lock);
+      return fresh;
+    }
+
+    // Get an entry without holding the bucket lock,
+    // then look again.
+    release(&b->lock);
+    fresh = inew();
+  }
+}
+
 // Increment reference count for ip.
 // Returns ip to enable ip = idup(ip1) idiom.
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
+  struct ibucket *b = ibucket(ip->dev, ip->inum);
+
+  acquire(&b->lock);
   ip->ref++;
-  release(&icache.lock);
+  release(&b->lock);
   return ip;
 }
 
@@ -333,7 +559,9 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&icache.lock);
+  struct ibucket *b = ibucket(ip->dev, ip->inum);
+
+  acquire(&b->lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -342,8 +570,10 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&icache.lock);
+    release(&b->lock);
 
+    if(ip->type == T_DIR)
+      dcache_purge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
@@ -351,11 +581,26 @@ iput(struct inode *ip)
 
     releasesleep(&ip->lock);
 
-    acquire(&icache.lock);
+    acquire(&b->lock);
   }
 
   ip->ref--;
-  release(&icache.lock);
+  if(ip->ref == 0){
+    // Keep it cached. An entry that no longer holds a
+    // valid inode goes to the cold end to be reused first.
+    acquire(&icache.lrulock);
+    if(ip->valid){
+      ip->lnext = icache.lru.lnext;
+      ip->lprev = &icache.lru;
+    } else {
+      ip->lnext = &icache.lru;
+      ip->lprev = icache.lru.lprev;
+    }
+    ip->lnext->lprev = ip;
+    ip->lprev->lnext = ip;
+    release(&icache.lrulock);
+  }
+  release(&b->lock);
 }
 
 // Common idiom: unlock, then put.
@@ -371,38 +616,93 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT], the next NDINDIRECT
+// through the double-indirect block ip->addrs[NDIRECT+1], and
+// the next NTINDIRECT through the triple-indirect block
+// ip->addrs[NDIRECT+2].
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmapz allocates one next to the
+// block before it, zeroed unless zero is 0 (the caller will
+// overwrite the whole block). *fresh is set if the block was
+// allocated unzeroed, else cleared.
 static uint
-bmap(struct inode *ip, uint bn)
+bmapz(struct inode *ip, uint bn, int zero, int *fresh)
 {
-  uint addr, *a;
+  uint addr, *a, level, i;
+  uint64 n;
   struct buf *bp;
 
+  *fresh = 0;
   if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[bn]) == 0){
+      ip->addrs[bn] = addr = balloc(ip->dev, bn > 0 ? ip->addrs[bn-1] : 0, zero);
+      *fresh = !zero;
+    }
     return addr;
   }
   bn -= NDIRECT;
 
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+  // Find the level of indirection that maps bn; n is the
+  // number of blocks that level maps.
+  for(level = 1, n = NINDIRECT; bn >= n; level++, n *= NINDIRECT){
+    if(level == 3)
+      panic("bmap: out of range");
+    bn -= n;
+  }
+
+  // Walk down from the root block for that level,
+  // allocating index blocks as necessary.
+  i = NDIRECT+level-1;
+  if((addr = ip->addrs[i]) == 0)
+    ip->addrs[i] = addr = balloc(ip->dev, ip->addrs[i-1], 1);
+  for(; level > 0; level--){
+    n /= NINDIRECT;
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    i = bn / n;
+    if((addr = a[i]) == 0){
+      a[i] = addr = balloc(ip->dev, i > 0 ? a[i-1] : bp->blockno,
+                           level > 1 || zero);
+      if(level == 1)
+        *fresh = !zero;
       log_write(bp);
     }
     brelse(bp);
-    return addr;
+    bn %= n;
   }
+  return addr;
+}
+
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  int fresh;
 
-  panic("bmap: out of range");
+  return bmapz(ip, bn, 1, &fresh);
+}
+
+// Free the index block addr, which has the given level of
+// indirection, and every block it maps.
+static void
+itrunclevel(uint dev, uint addr, int level)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    if(level > 1)
+      itrunclevel(dev, a[j], level-1);
+    else
+      bfree(dev, a[j]);
+  }
+  brelse(bp);
+  bfree(dev, addr);
 }
 
 // Truncate inode (discard contents).
@@ -413,10 +713,9 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
 
+  textpurge(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -424,16 +723,11 @@ itrunc(struct inode *ip)
     }
   }
 
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+  for(i = NDIRECT; i < NADDRS; i++){
+    if(ip->addrs[i]){
+      itrunclevel(ip->dev, ip->addrs[i], i - NDIRECT + 1);
+      ip->addrs[i] = 0;
     }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
   }
 
   ip->size = 0;
@@ -449,7 +743,7 @@ stati(struct inode *ip, struct stat *st)
   st->ino = ip->inum;
   st->type = ip->type;
   st->nlink = ip->nlink;
-  st->size = ip->size;
+  st->size = ip->size + ip->wblen;
 }
 
 // Read data from inode.
@@ -459,23 +753,27 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, dn;
   struct buf *bp;
 
-  if(off > ip->size || off + n < off)
+  if(off > ip->size + ip->wblen || off + n < off)
     return -1;
-  if(off + n > ip->size)
-    n = ip->size - off;
+  if(off + n > ip->size + ip->wblen)
+    n = ip->size + ip->wblen - off;
 
-  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+  // Bytes at and beyond ip->size come from the delayed-write buffer.
+  dn = off < ip->size ? min(n, ip->size - off) : 0;
+  for(tot=0; tot<dn; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
+    m = min(dn - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
-      break;
+      return n;
     }
     brelse(bp);
   }
+  if(n > dn)
+    either_copyout(user_dst, dst, ip->wbuf + (off - ip->size), n - dn);
   return n;
 }
 
@@ -488,16 +786,26 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  int fresh;
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  textpurge(ip);
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
+    // A new block that is about to be overwritten
+    // entirely need not be zeroed first.
+    bp = bread(ip->dev, bmapz(ip, off/BSIZE, m < BSIZE, &fresh));
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+      if(fresh){
+        // Don't leave the unzeroed new block behind; a block
+        // that was already in the file is left as it was.
+        memset(bp->data, 0, BSIZE);
+        log_write(bp);
+      }
       brelse(bp);
       break;
     }
@@ -517,6 +825,136 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   return n;
 }
 
+// Delayed writes.
+//
+// Small appends to a regular file are collected in a page
+// hanging off the in-memory inode (ip->wbuf) instead of each
+// running its own transaction. The ip->wblen pending bytes
+// belong at offsets [ip->size, ip->size + ip->wblen); readi()
+// and stati() include them. While any are pending the buffer
+// holds a reference to the inode, so it stays in the icache.
+// The flusher thread writes buffers back every WBTICKS ticks,
+// in as few transactions as the log allows; fsync() and
+// writes that are not appends write them back at once.
+
+// Bytes written back per transaction; see filewrite().
+#define WBCHUNK (((MAXOPBLOCKS-1-1-2) / 2) * BSIZE)
+
+// Try to buffer a write of n bytes from user address src at
+// offset off. Returns n if the bytes were buffered, 0 if the
+// write must go to the disk (after iflush() if ip->wblen is
+// non-zero), or -1 if src is bad.
+// Caller must hold ip->lock.
+int
+iwbuffer(struct inode *ip, uint64 src, uint off, int n)
+{
+  if(ip->type != T_FILE || n <= 0 || off != ip->size + ip->wblen)
+    return 0;
+  if(ip->wblen + n > PGSIZE || off + n > MAXFILE*BSIZE || off + n < off)
+    return 0;
+  if(ip->wbuf == 0 && (ip->wbuf = kalloc()) == 0)
+    return 0;
+  if(either_copyin(ip->wbuf + ip->wblen, 1, src, n) == -1)
+    return -1;
+  if(ip->wblen == 0)
+    idup(ip);
+  ip->wblen += n;
+  return n;
+}
+
+// Write ip's buffered appends to the disk. Data of a file
+// that no one can reach any more is discarded instead.
+// Caller must hold a reference to ip, but not ip->lock,
+// and must not be in a transaction. held is the number of
+// the caller's references that are not an open file's (so
+// 0 when flushing through a file, which is still reachable).
+void
+iflush(struct inode *ip, int held)
+{
+  struct ibucket *b;
+  int n, dead;
+
+  for(;;){
+    begin_op(ip->dev);
+    ilock(ip);
+    if(ip->wblen == 0){
+      iunlock(ip);
+      end_op(ip->dev);
+      return;
+    }
+    b = ibucket(ip->dev, ip->inum);
+    acquire(&b->lock);
+    dead = ip->nlink == 0 && held > 0 && ip->ref == held + 1;  // + the buffer's
+    release(&b->lock);
+    n = ip->wblen;
+    if(!dead){
+      if(n > WBCHUNK)
+        n = WBCHUNK;
+      if(writei(ip, 0, (uint64)ip->wbuf, ip->size, n) != n)
+        n = ip->wblen;  // can't grow the file; drop the rest
+    }
+    ip->wblen -= n;
+    memmove(ip->wbuf, ip->wbuf + n, ip->wblen);
+    if(ip->wblen == 0){
+      kfree(ip->wbuf);
+      ip->wbuf = 0;
+      iunlock(ip);
+      iput(ip);  // the buffer's reference
+    } else {
+      iunlock(ip);
+    }
+    end_op(ip->dev);
+  }
+}
+
+// Write back every inode's buffered appends.
+void
+iflushall(void)
+{
+  struct ibucket *b;
+  struct inode *ip;
+  int n;
+
+  for(b = icache.bucket; b < &icache.bucket[NIHASH]; b++){
+    // The chain may change while an inode is being flushed,
+    // so rescan it after each, a bounded number of times.
+    for(n = 0; n < NINODE; n++){
+      acquire(&b->lock);
+      // Reading wblen without ip->lock is only a hint;
+      // iflush() looks again with the lock held.
+      for(ip = b->head; ip; ip = ip->hnext)
+        if(ip->ref > 0 && ip->wblen > 0)
+          break;
+      if(ip == 0){
+        release(&b->lock);
+        break;
+      }
+      ip->ref++;
+      release(&b->lock);
+      iflush(ip, 1);
+      begin_op(ip->dev);
+      iput(ip);
+      end_op(ip->dev);
+    }
+  }
+}
+
+// The flusher thread.
+static void
+flusher(void *arg)
+{
+  uint ticks0;
+
+  for(;;){
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < WBTICKS)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+    iflushall();
+  }
+}
+
 // Directories
 
 int
@@ -525,64 +963,443 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Scan slots [from, to) of directory block bn, held in bp.
+// Returns the inum of the entry for name (setting *poff to
+// its byte offset), or 0. If pfree is non-zero and *pfree is
+// still dp->size, sets it to the first empty slot seen.
+static uint
+dirscanblk(struct inode *dp, struct buf *bp, uint bn, int from, int to,
+           char *name, uint *poff, uint *pfree)
+{
+  struct dirent *de;
+  uint off;
+
+  for(de = (struct dirent*)bp->data + from; de < (struct dirent*)bp->data + to; de++){
+    off = bn*BSIZE + (uchar*)de - bp->data;
+    if(de->inum == 0){
+      if(pfree && *pfree == dp->size)
+        *pfree = off;
+      continue;
+    }
+    if(namecmp(name, de->name) == 0){
+      // entry matches path element
+      if(poff)
+        *poff = off;
+      return de->inum;
+    }
+  }
+  return 0;
+}
+
+// Hashed directories; see the comment above struct dirhdr.
+
+#define DIRH_HDR(bp, slot)  ((struct dirhdr*)(bp)->data + (slot))
+#define DIRH_MASK(depth)    ((1U << (depth)) - 1)
+
+// Don't split a bucket more than this many times for one
+// insert, to keep dirlink() within MAXOPBLOCKS. A bucket that
+// is still full overflows into a chained block instead.
+#define DIRH_MAXSPLIT 1
+
+// Is dp (whose block 0 is held in b0) a hashed directory?
+static int
+dirhashed(struct inode *dp, struct buf *b0)
+{
+  struct dirhdr *h = DIRH_HDR(b0, 2);
+
+  return dp->size > BSIZE && h->inum == 0 && h->magic == DIRH_MAGIC;
+}
+
+// Entry i of the bucket table in block 0.
+static ushort*
+dirhptr(struct buf *b0, uint i)
+{
+  return &((struct dirtab*)b0->data + 3 + i/DIRH_PPS)->bn[i%DIRH_PPS];
+}
+
+// Directory block number of the bucket that name hashes to.
+static uint
+dirhbucket(struct buf *b0, char *name)
+{
+  return *dirhptr(b0, dirhash(name) & DIRH_MASK(DIRH_HDR(b0, 2)->depth));
+}
+
+// Append an empty bucket block with local depth depth to dp,
+// setting *pbn to its directory block number. Returns the
+// locked buffer, or 0 if the directory is at its maximum size.
+static struct buf*
+dirhnewblk(struct inode *dp, uint depth, uint *pbn)
+{
+  struct buf *bp;
+  struct dirhdr *h;
+  uint bn;
+  int fresh;
+
+  bn = dp->size / BSIZE;
+  if(bn >= MAXFILE || bn > 0xffff)
+    return 0;
+  bp = bread(dp->dev, bmapz(dp, bn, 0, &fresh));
+  memset(bp->data, 0, BSIZE);
+  h = DIRH_HDR(bp, 0);
+  h->magic = DIRH_MAGIC;
+  h->depth = depth;
+  dp->size += BSIZE;
+  iupdate(dp);
+  *pbn = bn;
+  return bp;
+}
+
+// First empty slot in the bucket block bn held in bp, or -1.
+static int
+dirhfree(struct buf *bp, uint bn)
+{
+  struct dirent *de;
+
+  for(de = (struct dirent*)bp->data + 1; de < (struct dirent*)bp->data + DPB; de++)
+    if(de->inum == 0)
+      return bn*BSIZE + (uchar*)de - bp->data;
+  return -1;
+}
+
+// Convert the full, single-block linear directory dp (block 0
+// held in b0) into a hashed directory with two buckets.
+static int
+dirhconvert(struct inode *dp, struct buf *b0)
+{
+  struct buf *bp[2];
+  struct dirent *de, *to[2];
+  struct dirhdr *h;
+  uint bn[2];
+  int i;
+
+  if((bp[0] = dirhnewblk(dp, 1, &bn[0])) == 0)
+    return -1;
+  if((bp[1] = dirhnewblk(dp, 1, &bn[1])) == 0){
+    brelse(bp[0]);
+    return -1;
+  }
+  to[0] = (struct dirent*)bp[0]->data + 1;
+  to[1] = (struct dirent*)bp[1]->data + 1;
+
+  // A bucket holds DPB-1 entries, so the DPB-2 entries
+  // after "." and ".." always fit.
+  for(de = (struct dirent*)b0->data + 2; de < (struct dirent*)b0->data + DPB; de++){
+    if(de->inum){
+      i = dirhash(de->name) & 1;
+      *to[i]++ = *de;
+    }
+  }
+  memset(b0->data + 2*sizeof(struct dirent), 0, BSIZE - 2*sizeof(struct dirent));
+  h = DIRH_HDR(b0, 2);
+  h->magic = DIRH_MAGIC;
+  h->depth = 1;
+  *dirhptr(b0, 0) = bn[0];
+  *dirhptr(b0, 1) = bn[1];
+
+  for(i = 0; i < 2; i++){
+    log_write(bp[i]);
+    brelse(bp[i]);
+  }
+  log_write(b0);
+  return 0;
+}
+
+// Split the full bucket bn, held in bp, doubling the bucket
+// table in b0 if the bucket is already at the global depth.
+// Releases bp.
+static int
+dirhsplit(struct inode *dp, struct buf *b0, struct buf *bp, uint bn)
+{
+  struct dirhdr *th, *bh;
+  struct dirent *de, *to;
+  struct buf *np;
+  uint i, n, nbn, ld;
+
+  th = DIRH_HDR(b0, 2);
+  bh = DIRH_HDR(bp, 0);
+  ld = bh->depth;
+  if((np = dirhnewblk(dp, ld+1, &nbn)) == 0){
+    brelse(bp);
+    return -1;
+  }
+  if(ld == th->depth){
+    n = 1U << th->depth;
+    for(i = 0; i < n; i++)
+      *dirhptr(b0, n + i) = *dirhptr(b0, i);
+    th->depth++;
+  }
+  bh->depth = ld+1;
+
+  // Entries with bit ld of their hash set move to the new bucket.
+  to = (struct dirent*)np->data + 1;
+  for(de = (struct dirent*)bp->data + 1; de < (struct dirent*)bp->data + DPB; de++){
+    if(de->inum && (dirhash(de->name) >> ld) & 1){
+      *to++ = *de;
+      memset(de, 0, sizeof(*de));
+    }
+  }
+  n = 1U << th->depth;
+  for(i = 0; i < n; i++)
+    if(*dirhptr(b0, i) == bn && (i >> ld) & 1)
+      *dirhptr(b0, i) = nbn;
+
+  log_write(np);
+  brelse(np);
+  log_write(bp);
+  brelse(bp);
+  log_write(b0);
+  return 0;
+}
+
+// Make room for name in the directory dp, after dirscan()
+// found no empty slot where name belongs. Converts a full
+// one-block directory to the hashed format, and splits or
+// chains onto a full bucket. Returns the byte offset of an
+// empty slot, or -1 if the directory cannot grow.
+static int
+dirgrow(struct inode *dp, char *name)
+{
+  struct buf *b0, *bp, *np;
+  struct dirhdr *th, *bh;
+  uint bn, nbn;
+  int nsplit, off;
+
+  b0 = bread(dp->dev, bmap(dp, 0));
+  if(!dirhashed(dp, b0)){
+    if(dp->size != BSIZE){
+      // Multi-block linear directory from an older image.
+      brelse(b0);
+      return dp->size;
+    }
+    if(dirhconvert(dp, b0) < 0){
+      brelse(b0);
+      return -1;
+    }
+  }
+
+  th = DIRH_HDR(b0, 2);
+  for(nsplit = 0; ; nsplit++){
+    bn = dirhbucket(b0, name);
+    bp = bread(dp->dev, bmap(dp, bn));
+    if((off = dirhfree(bp, bn)) >= 0)
+      break;
+    bh = DIRH_HDR(bp, 0);
+    if(bh->next || nsplit == DIRH_MAXSPLIT ||
+       (bh->depth == th->depth && (2U << th->depth) > DIRH_NPTR)){
+      // Chain an overflow block onto the end of the bucket.
+      while(bh->next){
+        bn = bh->next;
+        brelse(bp);
+        bp = bread(dp->dev, bmap(dp, bn));
+        bh = DIRH_HDR(bp, 0);
+      }
+      if((np = dirhnewblk(dp, bh->depth, &nbn)) == 0){
+        off = -1;
+        break;
+      }
+      bh->next = nbn;
+      log_write(bp);
+      log_write(np);
+      brelse(np);
+      off = nbn*BSIZE + sizeof(struct dirent);
+      break;
+    }
+    if(dirhsplit(dp, b0, bp, bn) < 0){
+      brelse(b0);
+      return -1;
+    }
+  }
+  brelse(bp);
+  brelse(b0);
+  return off;
+}
+
+// Scan the entries of directory dp one block at a time,
+// holding a single buffer per block rather than calling
+// readi() for each entry. In a hashed directory only the
+// bucket for name is scanned. Returns the inum of the entry
+// for name (setting *poff to its byte offset), or 0 if there
+// is none. If pfree is non-zero, sets *pfree to the offset of
+// an empty slot where name could go, or to dp->size if none.
+// Caller must hold dp->lock.
+static uint
+dirscan(struct inode *dp, char *name, uint *poff, uint *pfree)
+{
+  uint bn, n, inum;
+  struct buf *bp;
+
+  if(pfree)
+    *pfree = dp->size;
+
+  if(dp->size > BSIZE){
+    bp = bread(dp->dev, bmap(dp, 0));
+    if(dirhashed(dp, bp)){
+      inum = dirscanblk(dp, bp, 0, 0, 2, name, poff, 0);
+      bn = dirhbucket(bp, name);
+      brelse(bp);
+      while(inum == 0 && bn != 0){
+        bp = bread(dp->dev, bmap(dp, bn));
+        inum = dirscanblk(dp, bp, bn, 1, DPB, name, poff, pfree);
+        bn = DIRH_HDR(bp, 0)->next;
+        brelse(bp);
+      }
+      return inum;
+    }
+    brelse(bp);
+  }
+
+  for(bn = 0; bn*BSIZE < dp->size; bn++){
+    bp = bread(dp->dev, bmap(dp, bn));
+    n = dp->size - bn*BSIZE;
+    if(n > BSIZE)
+      n = BSIZE;
+    inum = dirscanblk(dp, bp, bn, 0, n/sizeof(struct dirent), name, poff, pfree);
+    brelse(bp);
+    if(inum)
+      return inum;
+  }
+  return 0;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Callers that don't need the offset are served
+// from the dcache when possible.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint inum;
+  struct inode *ip;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
-    }
-  }
+  if(poff == 0 && dcache_get(dp->dev, dp->inum, name, &ip))
+    return ip;
 
-  return 0;
+  inum = dirscan(dp, name, poff, 0);
+  dcache_put(dp->dev, dp->inum, name, inum);
+  if(inum == 0)
+    return 0;
+  return iget(dp->dev, inum);
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
+// Returns -1 if name is present or the directory is full.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
+  uint off;
+  int goff;
   struct dirent de;
   struct inode *ip;
 
-  // Check that name is not present.
-  if((ip = dirlookup(dp, name, 0)) != 0){
+  // A cached entry answers "is it present?" without a scan.
+  if(dcache_get(dp->dev, dp->inum, name, &ip) && ip != 0){
     iput(ip);
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  // Check that name is not present and find an empty
+  // dirent in the same pass.
+  if(dirscan(dp, name, 0, &off) != 0)
+    return -1;
+  if(off == dp->size && dp->size >= BSIZE){
+    if((goff = dirgrow(dp, name)) < 0)
+      return -1;
+    off = goff;
   }
 
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcache_put(dp->dev, dp->inum, name, inum);
 
   return 0;
 }
 
+// Remove the entry for name, found by dirlookup at byte
+// offset off, from the directory dp.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink");
+  dcache_put(dp->dev, dp->inum, name, 0);
+}
+
+// Bytes of delayed appends pending for inode (dev, inum), if
+// it is cached. Read without the inode's lock, so only a
+// snapshot, which is all a directory listing needs.
+static uint
+ipending(uint dev, uint inum)
+{
+  struct ibucket *b;
+  struct inode *ip;
+  uint n;
+
+  b = ibucket(dev, inum);
+  n = 0;
+  acquire(&b->lock);
+  for(ip = b->head; ip; ip = ip->hnext)
+    if(ip->dev == dev && ip->inum == inum && ip->ref > 0)
+      n = ip->wblen;
+  release(&b->lock);
+  return n;
+}
+
+// Copy up to n entries of directory dp, starting at byte
+// offset *poff, to user address dst as struct dirstats, and
+// advance *poff past them. Each directory block is read once,
+// and each entry's status comes straight from its dinode's
+// block, without locking the entry's inode.
+// Returns the number of entries copied, or -1 if dst is bad.
+// Caller must hold dp->lock.
+int
+dirstats(struct inode *dp, uint *poff, uint64 dst, int n)
+{
+  struct buf *bp, *ibp;
+  struct dirent *de;
+  struct dinode *dip;
+  struct dirstat ds;
+  uint off, bn;
+  int i;
+
+  i = 0;
+  off = *poff - *poff % sizeof(*de);
+  while(i < n && off < dp->size){
+    bn = off / BSIZE;
+    bp = bread(dp->dev, bmap(dp, bn));
+    for(; i < n && off < dp->size && off / BSIZE == bn; off += sizeof(*de)){
+      de = (struct dirent*)(bp->data + off % BSIZE);
+      if(de->inum == 0)
+        continue;
+      ibp = bread(dp->dev, IBLOCK(de->inum, sb));
+      dip = (struct dinode*)ibp->data + de->inum % IPB;
+      ds.ino = de->inum;
+      ds.type = dip->type;
+      ds.nlink = dip->nlink;
+      ds.size = dip->size;
+      brelse(ibp);
+      ds.size += ipending(dp->dev, de->inum);
+      memset(ds.name, 0, sizeof(ds.name));
+      memmove(ds.name, de->name, DIRSIZ);
+      if(either_copyout(1, dst + i*sizeof(ds), &ds, sizeof(ds)) == -1){
+        brelse(bp);
+        return -1;
+      }
+      i++;
+    }
+    brelse(bp);
+  }
+  *poff = off;
+  return i;
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -637,6 +1454,17 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
+    // Fast path: a dcache hit needs neither the directory's
+    // lock nor its blocks. Only directories have dcache
+    // entries, so ip is known to be one.
+    if(!(nameiparent && *path == '\0') &&
+       dcache_get(ip->dev, ip->inum, name, &next)){
+      iput(ip);
+      if(next == 0)
+        return 0;
+      ip = next;
+      continue;
+    }
     ilock(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
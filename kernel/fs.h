@@ -6,7 +6,12 @@
 
 
 #define ROOTINO  1   // root i-number
-#define BSIZE 1024  // block size
+
+// Block size; a power of two from 1024 to PGSIZE. The Makefile
+// sets it for the kernel, user programs and mkfs together.
+#ifndef BSIZE
+#define BSIZE 4096
+#endif
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
@@ -23,13 +28,17 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint bsize;        // Block size the image was made with (BSIZE)
 };
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define NTINDIRECT (NDINDIRECT * NINDIRECT)
+#define NADDRS (NDIRECT + 3)   // direct, indirect, double, triple
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT + NTINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -38,7 +47,7 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NADDRS];   // Data block addresses
 };
 
 // Inodes per block.
@@ -61,4 +70,44 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Directory entries per block.
+#define DPB           (BSIZE / sizeof(struct dirent))
+
+// A directory that outgrows one block is converted to a hashed
+// (extendible hashing) format. Block 0 keeps "." and ".." in
+// slots 0 and 1, a dirhdr in slot 2, and the bucket table in the
+// remaining slots. Every other block is a bucket whose slot 0 is
+// a dirhdr. All of these slots have inum 0, so code that reads a
+// directory as a plain array of dirents still works.
+struct dirhdr {
+  ushort inum;          // Always 0
+  ushort magic;         // DIRH_MAGIC
+  ushort depth;         // Global depth (block 0) or local depth (bucket)
+  ushort next;          // Bucket: next overflow block, 0 if none
+  ushort pad[4];
+};
+
+// Bucket table slot: seven directory block numbers.
+#define DIRH_PPS (sizeof(struct dirent)/sizeof(ushort) - 1)
+struct dirtab {
+  ushort inum;          // Always 0
+  ushort bn[DIRH_PPS];
+};
+
+#define DIRH_MAGIC 0x4844
+#define DIRH_NPTR ((DPB - 3) * DIRH_PPS)   // bucket table capacity
+
+// Hash of a directory entry name (FNV-1a).
+static inline uint
+dirhash(const char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261U;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619U;
+  return h;
+}
+
 #endif
@@ -12,10 +12,22 @@
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// Reference counts of pages mapped by more than one page
+// table (shared text, copy-on-write data). kalloc() returns
+// a page with one reference; kdup() adds one and kfree()
+// drops one, freeing the page with the last.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
+struct {
+  struct spinlock lock;
+  ushort cnt[(PHYSTOP - KERNBASE) / PGSIZE];
+} kref;
+
 void
 kinit()
 {
   char *p = (char *) PGROUNDUP((uint64) end);
+  initlock(&kref.lock, "kref");
   bd_init(p, (void*)PHYSTOP);
 }
 
@@ -23,12 +35,42 @@ kinit()
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// If the page is shared, just drop this reference.
 void
 kfree(void *pa)
 {
+  acquire(&kref.lock);
+  if(kref.cnt[PA2REF(pa)] > 1){
+    kref.cnt[PA2REF(pa)]--;
+    release(&kref.lock);
+    return;
+  }
+  kref.cnt[PA2REF(pa)] = 0;
+  release(&kref.lock);
   bd_free(pa);
 }
 
+// Take another reference to the page pa.
+void
+kdup(void *pa)
+{
+  acquire(&kref.lock);
+  kref.cnt[PA2REF(pa)]++;
+  release(&kref.lock);
+}
+
+// Return the number of references to the page pa.
+int
+krefs(void *pa)
+{
+  int n;
+
+  acquire(&kref.lock);
+  n = kref.cnt[PA2REF(pa)];
+  release(&kref.lock);
+  return n;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -36,6 +78,36 @@ void *
 kalloc(void)
 {
   char* mem = bd_malloc(PGSIZE);
-  if(mem) memset(mem, 0, PGSIZE);
+  // Under memory pressure, shrink the inode and text caches
+  // and retry.
+  if(mem == 0 && ireclaim() + textreclaim() > 0)
+    mem = bd_malloc(PGSIZE);
+  if(mem){
+    memset(mem, 0, PGSIZE);
+    acquire(&kref.lock);
+    kref.cnt[PA2REF(mem)] = 1;
+    release(&kref.lock);
+  }
   return mem;
 }
+
+// Text of /proc/meminfo. Shared pages are those mapped by
+// more than one page table.
+int
+meminfo(char *buf, int n)
+{
+  int i, shared, len;
+
+  shared = 0;
+  acquire(&kref.lock);
+  for(i = 0; i < NELEM(kref.cnt); i++)
+    if(kref.cnt[i] > 1)
+      shared++;
+  release(&kref.lock);
+
+  len = snprintf(buf, n, "MemTotal:\t%d kB\n",
+                 (int)((PHYSTOP - PGROUNDUP((uint64)end)) / 1024));
+  len += snprintf(buf+len, n-len, "MemFree:\t%d kB\n", (int)(bd_nfree() / 1024));
+  len += snprintf(buf+len, n-len, "MemShared:\t%d kB\n", shared * (PGSIZE / 1024));
+  return len;
+}
@@ -0,0 +1,232 @@
+// Kernel log.
+//
+// printf() appends to a ring buffer belonging to the CPU it
+// runs on, with interrupts off, so each ring has exactly one
+// writer and needs no lock. Each line starts with the tick
+// count and the CPU number. The klogd thread copies new text
+// from the rings to the console every tick; a writer that
+// gets more than KLOGHIWAT bytes ahead of the console drains
+// its own ring then and there, so a burst longer than a ring
+// slows the writer down rather than losing text. The DMESG
+// device returns what the rings still hold; panic() writes
+// out whatever has not been drained, bypassing the uart
+// buffer.
+//
+// A ring's w counts every byte ever written, and only its
+// writer changes it. Readers copy from the ring, then look at
+// w again and discard whatever the writer may have overwritten
+// in the meantime. Only the holder of a ring's draining flag
+// sends its text to the console and moves drained.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "defs.h"
+#include "proc.h"
+
+struct klog {
+  char buf[KLOGSIZE];
+  uint64 w;       // bytes written
+  uint64 drained; // bytes sent to the console
+  int draining;   // someone is sending text to the console
+  int midline;    // the last byte written was not a newline
+};
+
+#define KLOGHIWAT (KLOGSIZE/2)
+
+static struct klog klog[NCPU];
+
+static void klogdrain(struct klog*);
+
+static void
+kput(struct klog *k, char c)
+{
+  k->buf[k->w % KLOGSIZE] = c;
+  __sync_synchronize();
+  k->w++;
+}
+
+static void
+kputnum(struct klog *k, uint x)
+{
+  char buf[12];
+  int i;
+
+  i = 0;
+  do {
+    buf[i++] = '0' + x % 10;
+  } while((x /= 10) != 0);
+  while(--i >= 0)
+    kput(k, buf[i]);
+}
+
+// Append c to this CPU's log.
+// Caller must have interrupts off (see printf).
+void
+klogputc(int c)
+{
+  struct klog *k = &klog[cpuid()];
+
+  if(!k->midline){
+    kput(k, '[');
+    kputnum(k, ticks);
+    kput(k, ' ');
+    kput(k, 'c');
+    kput(k, 'p');
+    kput(k, 'u');
+    kputnum(k, cpuid());
+    kput(k, ']');
+    kput(k, ' ');
+  }
+  kput(k, c);
+  k->midline = (c != '\n');
+  if(k->w - k->drained > KLOGHIWAT)
+    klogdrain(k);
+}
+
+// Copy up to n bytes of k's log, starting with byte *pos,
+// to dst, and advance *pos. Bytes that have been overwritten
+// are skipped. Returns the number of bytes copied.
+static int
+klogcopy(struct klog *k, uint64 *pos, char *dst, int n)
+{
+  uint64 w, start;
+  int i, lost;
+
+  w = k->w;
+  __sync_synchronize();
+  if(w > KLOGSIZE && *pos < w - KLOGSIZE)
+    *pos = w - KLOGSIZE;
+  if(n > w - *pos)
+    n = w - *pos;
+  start = *pos;
+  for(i = 0; i < n; i++)
+    dst[i] = k->buf[(start + i) % KLOGSIZE];
+
+  // The writer may have lapped us while we copied.
+  __sync_synchronize();
+  w = k->w;
+  lost = 0;
+  if(w > KLOGSIZE && start < w - KLOGSIZE)
+    lost = w - KLOGSIZE - start;
+  if(lost >= n){
+    *pos = w - KLOGSIZE;
+    return 0;
+  }
+  if(lost > 0)
+    memmove(dst, dst + lost, n - lost);
+  *pos = start + n;
+  return n - lost;
+}
+
+// Send k's undrained text to the console from its writer,
+// which has interrupts off: uartputc() spins rather than
+// sleeps when the uart buffer is full. If klogd holds the
+// flag, it is draining this ring already.
+static void
+klogdrain(struct klog *k)
+{
+  char buf[64];
+  int i, n;
+
+  if(__sync_lock_test_and_set(&k->draining, 1) != 0)
+    return;
+  while((n = klogcopy(k, &k->drained, buf, sizeof(buf))) > 0)
+    for(i = 0; i < n; i++)
+      uartputc(buf[i]);
+  __sync_lock_release(&k->draining);
+}
+
+// Write out everything not yet drained, straight to the
+// uart. Called by panic(), which ignores the draining flags.
+void
+klogflush(void)
+{
+  struct klog *k;
+  char buf[64];
+  int i, n;
+
+  for(k = klog; k < klog + NCPU; k++)
+    while((n = klogcopy(k, &k->drained, buf, sizeof(buf))) > 0)
+      for(i = 0; i < n; i++)
+        uartputc_sync(buf[i]);
+}
+
+// The klogd thread: copies new log text to the console.
+static void
+klogd(void *arg)
+{
+  struct klog *k;
+  char buf[128];
+  int n;
+
+  for(;;){
+    for(k = klog; k < klog + NCPU; k++){
+      if(__sync_lock_test_and_set(&k->draining, 1) != 0)
+        continue;   // its writer is draining it
+      while((n = klogcopy(k, &k->drained, buf, sizeof(buf))) > 0)
+        uartwrite(buf, n);
+      __sync_lock_release(&k->draining);
+    }
+
+    acquire(&tickslock);
+    sleep(&ticks, &tickslock);
+    release(&tickslock);
+  }
+}
+
+// Read from the DMESG device: the text still held by each
+// CPU's log, one CPU after another. f->off is the position
+// in that sequence.
+static int
+dmesgread(struct file *f, int user_dst, uint64 dst, int n)
+{
+  struct klog *k;
+  uint64 pos, len, skip, w;
+  char buf[128];
+  int tot, m;
+
+  skip = f->off;
+  tot = 0;
+  for(k = klog; k < klog + NCPU && tot < n; k++){
+    w = k->w;
+    len = w < KLOGSIZE ? w : KLOGSIZE;
+    if(skip >= len){
+      skip -= len;
+      continue;
+    }
+    pos = w - len + skip;
+    skip = 0;
+    while(tot < n){
+      m = n - tot < sizeof(buf) ? n - tot : sizeof(buf);
+      if((m = klogcopy(k, &pos, buf, m)) == 0)
+        break;
+      if(either_copyout(user_dst, dst + tot, buf, m) == -1)
+        return -1;
+      tot += m;
+    }
+  }
+  f->off += tot;
+  return tot;
+}
+
+void
+kloginit(void)
+{
+  devsw[DMESG].read = dmesgread;
+  devsw[DMESG].write = 0;
+}
+
+// Start the klogd thread. Until then, log text waits in the
+// rings.
+void
+klogstart(void)
+{
+  if(kthread("klogd", klogd, 0) < 0)
+    panic("klogstart");
+}
@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -192,12 +193,18 @@ write_log(int dev)
 static void
 commit(int dev)
 {
+  uint64 t0;
+  int n;
+
   if (log[dev].lh.n > 0) {
+    t0 = r_time();
+    n = log[dev].lh.n;
     write_log(dev);     // Write modified blocks from cache to log
     write_head(dev);    // Write header to disk -- the real commit
     install_trans(dev); // Now install writes to home locations
     log[dev].lh.n = 0;
     write_head(dev);    // Erase the transaction from the log
+    TRACE(TR_COMMIT, n, r_time() - t0);
   }
 }
 
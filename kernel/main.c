@@ -18,13 +18,16 @@ main()
   if(cpuid() == 0){
     consoleinit();
     watchdoginit();
-    printfinit();
+    kloginit();      // kernel log
+    profinit();      // sampling profiler
+    traceinit();     // tracepoints
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    vdsoinit();      // vdso time page
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
@@ -32,9 +35,12 @@ main()
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode cache
+    dcacheinit();    // directory entry cache
+    textinit();      // shared text pages
     fileinit();      // file table
     virtio_disk_init(minor(ROOTDEV)); // emulated hard disk
     userinit();      // first user process
+    klogstart();     // copy the kernel log to the console
     __sync_synchronize();
     started = 1;
   } else {
@@ -33,6 +33,8 @@
 #define CLINT 0x2000000L
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define MTIME_HZ 10000000L  // CLINT_MTIME rate in qemu
+#define TICKCYCLES 1000000  // CLINT_MTIME cycles per timer interrupt
 
 // qemu puts programmable interrupt controller here.
 #define PLIC 0x0c000000L
@@ -66,9 +68,12 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   VDSO_TIME, VDSO_PROC (read-only, see vdso.h)
 //   TRAPFRAME (p->tf, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define VDSO_PROC (TRAPFRAME - PGSIZE)  // struct vdsoproc, per process
+#define VDSO_TIME (VDSO_PROC - PGSIZE)  // struct vdsotime, shared
 
 #define HEAP_THRESHOLD (8*1024*1024)
 
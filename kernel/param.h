@@ -5,15 +5,24 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE      200  // i-nodes cached before reusing unreferenced ones
+#define NDCACHE     128  // size of directory entry cache
+#define NTEXT       256  // size of shared text page cache
+#define KLOGSIZE    4096 // bytes of kernel log kept per CPU
+#define PROCFSBUF   (16*4096) // max size of a /proc file's text
 #define NDEV         10  // maximum major device number
+#define NWATCHDOG     4  // minors of the watchdog device
 #define ROOTDEV       0  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NSYSCALL     40  // size of tables indexed by syscall number
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define WBTICKS      30    // ticks between delayed-write flushes
+#define WSTICKS      2     // ticks after exec that count as program startup
+#define LOCKUPTICKS  50    // ticks without a timer interrupt before a hart is reported
 #define NDISK        2
 #define NPRIO        10
 #define DEF_PRIO     5
@@ -1,5 +1,6 @@
 //
 // formatted console output -- printf, panic.
+// printf() writes to the kernel log (see klog.c).
 //
 
 #include <stdarg.h>
@@ -16,17 +17,34 @@
 #include "proc.h"
 
 volatile int panicked = 0;
-
-// lock to avoid interleaving concurrent printf's.
-static struct {
-  struct spinlock lock;
-  int locking;
-} pr;
+volatile int panicking = 0; // console output bypasses the uart buffer
 
 static char digits[] = "0123456789abcdef";
 
+// Where formatted text goes: buf if it is not 0, which has
+// room for n bytes including the NUL; else the console if
+// direct is set; else the kernel log.
+struct out {
+  char *buf;
+  int n;
+  int len;      // bytes stored in buf so far
+  int direct;
+};
+
+static void
+putch(struct out *o, int c)
+{
+  if(o->buf){
+    if(o->len < o->n - 1)
+      o->buf[o->len++] = c;
+  } else if(o->direct || panicking)
+    consputc(c);
+  else
+    klogputc(c);
+}
+
 static void
-printint(int xx, int base, int sign)
+printint(struct out *o, int xx, int base, int sign)
 {
   char buf[16];
   int i;
@@ -46,35 +64,32 @@ printint(int xx, int base, int sign)
     buf[i++] = '-';
 
   while(--i >= 0)
-    consputc(buf[i]);
+    putch(o, buf[i]);
 }
 
 static void
-printptr(uint64 x)
+printptr(struct out *o, uint64 x)
 {
   int i;
-  consputc('0');
-  consputc('x');
+  putch(o, '0');
+  putch(o, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putch(o, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the console. only understands %d, %x, %p, %s.
-void
-printf_locking(int locking, char *fmt, va_list ap)
+// Only understands %d, %x, %p, %s.
+static void
+format(struct out *o, char *fmt, va_list ap)
 {
   int i, c;
   char *s;
 
-  if(locking)
-    acquire(&pr.lock);
-
   if (fmt == 0)
     panic("null fmt");
 
   for(i = 0; (c = fmt[i] & 0xff) != 0; i++){
     if(c != '%'){
-      consputc(c);
+      putch(o, c);
       continue;
     }
     c = fmt[++i] & 0xff;
@@ -82,54 +97,92 @@ printf_locking(int locking, char *fmt, va_list ap)
       break;
     switch(c){
     case 'd':
-      printint(va_arg(ap, int), 10, 1);
+      printint(o, va_arg(ap, int), 10, 1);
       break;
     case 'x':
-      printint(va_arg(ap, int), 16, 1);
+      printint(o, va_arg(ap, int), 16, 1);
       break;
     case 'p':
-      printptr(va_arg(ap, uint64));
+      printptr(o, va_arg(ap, uint64));
       break;
     case 's':
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        putch(o, *s);
       break;
     case '%':
-      consputc('%');
+      putch(o, '%');
       break;
     default:
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c);
+      putch(o, '%');
+      putch(o, c);
       break;
     }
   }
+}
+
+// Print to the kernel log, or straight to the console if
+// direct. Interrupts are off throughout, so a line is not
+// split by output from an interrupt handler on this CPU.
+static void
+vprintf(int direct, char *fmt, va_list ap)
+{
+  struct out o = { 0, 0, 0, direct };
 
-  if(locking)
-    release(&pr.lock);
+  if(panicked){
+    for(;;)
+      ;
+  }
+
+  push_off();
+  format(&o, fmt, ap);
+  pop_off();
+}
+
+// Format into buf, which has room for n bytes; the text is
+// cut short if it does not fit. Returns the length of what
+// was stored, not counting the terminating NUL.
+int
+snprintf(char *buf, int n, char *fmt, ...)
+{
+  struct out o = { buf, n, 0, 0 };
+  va_list ap;
+
+  if(n <= 0)
+    return 0;
+  va_start(ap, fmt);
+  format(&o, fmt, ap);
+  va_end(ap);
+  buf[o.len] = 0;
+  return o.len;
 }
 
 void
 printf(char *fmt, ...){
   va_list ap;
   va_start(ap, fmt);
-  printf_locking(pr.locking, fmt, ap);
+  vprintf(0, fmt, ap);
+  va_end(ap);
 }
 
-
+// Print straight to the console, not through the kernel log,
+// for debugging output that must appear even if klogd cannot
+// run: lock diagnostics and the ^P/^Q dumps.
 void
 printf_no_lock(char *fmt, ...){
   va_list ap;
   va_start(ap, fmt);
-  printf_locking(0, fmt, ap);
+  vprintf(1, fmt, ap);
+  va_end(ap);
 }
 
 void
 panic(char *s)
 {
-  pr.locking = 0;
+  panicking = 1;
+  klogflush();
   printf("PANIC: ");
   printf(s);
   printf("\n");
@@ -138,10 +191,3 @@ panic(char *s)
   for(;;)
     ;
 }
-
-void
-printfinit(void)
-{
-  initlock(&pr.lock, "pr");
-  pr.locking = 1;
-}
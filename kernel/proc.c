@@ -8,6 +8,10 @@
 #include "file.h"
 #include "proc.h"
 #include "defs.h"
+#include "vdso.h"
+#include "trace.h"
+#include "procinfo.h"
+#include "spawn.h"
 
 struct cpu cpus[NCPU];
 
@@ -40,7 +44,7 @@ struct vma *add_memory_area(struct proc *p, uint64 va_begin, uint64 va_end)
   }
   entry->va_begin = va_begin;
   entry->va_end = va_end;
-  entry->file = 0;
+  entry->ip = 0;
   entry->vma_flags = 0;
   entry->file_offset = 0;
   entry->file_nbytes = 0;
@@ -90,6 +94,21 @@ void free_vma(struct vma *vmas)
   }
 }
 
+/* Relâche les inodes référencés par une liste de VMAs. Doit être appelé dans
+ * une transaction (begin_op/end_op), sans tenir de verrou sur la liste. */
+void vma_iput(struct vma *vmas)
+{
+  struct vma *ma;
+  for (ma = vmas; ma; ma = ma->next)
+  {
+    if (ma->ip)
+    {
+      iput(ma->ip);
+      ma->ip = 0;
+    }
+  }
+}
+
 /* Récupère la VMA associée à une adresse virtuelle, ou 0 si aucune VMA n'est
  * associée à cette adresse.
  * Nécessite que le verrou p->vma_lock soit tenu.
@@ -128,22 +147,35 @@ uint64 max_addr_in_memory_areas(struct proc *p)
   return max;
 }
 
-/* Affiche une VMA. */
-void print_memory_area(struct proc *p, struct vma *ma)
+/* Écrit la description d'une VMA, sur une ligne, dans [buf] (de taille [n]).
+ * Renvoie la longueur écrite. */
+int format_memory_area(struct proc *p, struct vma *ma, char *buf, int n)
 {
-  printf("VA = [%p; %p[ RWX=%d%d%d", ma->va_begin, ma->va_end,
-         (ma->vma_flags & VMA_R) != 0, (ma->vma_flags & VMA_W) != 0,
-         (ma->vma_flags & VMA_X) != 0);
-  if (ma->file)
+  int len;
+
+  len = snprintf(buf, n, "VA = [%p; %p[ RWX=%d%d%d", ma->va_begin, ma->va_end,
+                 (ma->vma_flags & VMA_R) != 0, (ma->vma_flags & VMA_W) != 0,
+                 (ma->vma_flags & VMA_X) != 0);
+  if (ma->ip)
   {
-    printf(" file=%s off=0x%x n=0x%x", ma->file, ma->file_offset,
-           ma->file_nbytes);
+    len += snprintf(buf + len, n - len, " inum=%d off=0x%x n=0x%x",
+                    ma->ip->inum, ma->file_offset, ma->file_nbytes);
   }
   if (ma == p->stack_vma)
-    printf(" [stack]");
+    len += snprintf(buf + len, n - len, " [stack]");
   if (ma == p->heap_vma)
-    printf(" [heap]");
-  printf("\n");
+    len += snprintf(buf + len, n - len, " [heap]");
+  len += snprintf(buf + len, n - len, "\n");
+  return len;
+}
+
+/* Affiche une VMA. */
+void print_memory_area(struct proc *p, struct vma *ma)
+{
+  char line[128];
+
+  format_memory_area(p, ma, line, sizeof(line));
+  printf("%s", line);
 }
 
 /* Affiche la liste de VMAs associée à un processus. */
@@ -167,10 +199,10 @@ void vma_copy(struct proc *pdst, struct proc *psrc)
   while (ma)
   {
     struct vma *new_vma = add_memory_area(pdst, ma->va_begin, ma->va_end);
-    if (ma->file)
-      new_vma->file = strdup(ma->file);
+    if (ma->ip)
+      new_vma->ip = idup(ma->ip);
     else
-      new_vma->file = 0;
+      new_vma->ip = 0;
     new_vma->file_offset = ma->file_offset;
     new_vma->file_nbytes = ma->file_nbytes;
     new_vma->vma_flags = ma->vma_flags;
@@ -282,11 +314,29 @@ found:
     return 0;
   }
 
+  // And the process's vdso page.
+  if ((p->vdso = (struct vdsoproc *)kalloc()) == 0)
+  {
+    kfree((void *)p->tf);
+    p->tf = 0;
+    release(&p->lock);
+    return 0;
+  }
+  memset(p->vdso, 0, PGSIZE);
+  p->vdso->pid = p->pid;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
 
   p->priority = DEF_PRIO;
   p->memory_areas = 0;
+  p->exectick = ticks - WSTICKS;
+  memset(p->sccount, 0, sizeof(p->sccount));
+  memset(p->sccycles, 0, sizeof(p->sccycles));
+  p->utime = p->stime = 0;
+  p->minflt = p->majflt = 0;
+  p->rss = 0;
+  p->inblock = p->oublock = 0;
 
   // Set up new context to start executing at forkret,
   // which returns to user space.
@@ -305,6 +355,9 @@ static void freeproc(struct proc *p)
   if (p->tf)
     kfree((void *)p->tf);
   p->tf = 0;
+  if (p->vdso)
+    kfree((void *)p->vdso);
+  p->vdso = 0;
   if (p->pagetable)
     proc_freepagetable(p->pagetable, max_addr_in_memory_areas(p));
   if (p->cmd)
@@ -325,6 +378,8 @@ static void freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->kfn = 0;
+  p->karg = 0;
   p->state = UNUSED;
 }
 
@@ -346,17 +401,23 @@ pagetable_t proc_pagetable(struct proc *p)
   // map the trapframe just below TRAMPOLINE, for trampoline.S.
   mappages(pagetable, TRAPFRAME, PGSIZE, (uint64)(p->tf), PTE_R | PTE_W);
 
+  // map the vdso pages just below, readable by user code.
+  mappages(pagetable, VDSO_PROC, PGSIZE, (uint64)(p->vdso), PTE_R | PTE_U);
+  mappages(pagetable, VDSO_TIME, PGSIZE, (uint64)vdsotime, PTE_R | PTE_U);
+
   return pagetable;
 }
 
 // Free a process's page table, and free the
 // physical memory it refers to.
-void proc_freepagetable(pagetable_t pagetable, uint64 sz)
+// Returns the number of user pages freed.
+int proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, PGSIZE, 0);
   uvmunmap(pagetable, TRAPFRAME, PGSIZE, 0);
-  if (sz > 0)
-    uvmfree(pagetable, sz);
+  uvmunmap(pagetable, VDSO_PROC, PGSIZE, 0);
+  uvmunmap(pagetable, VDSO_TIME, PGSIZE, 0);
+  return uvmfree(pagetable, sz);
 }
 
 // a user program that calls exec("/init")
@@ -383,6 +444,7 @@ void userinit(void)
   // allocate one user page and copy init's instructions
   // and data into it.
   uvminit(p->pagetable, initcode, sizeof(initcode));
+  p->rss = 1;
   // p->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
@@ -401,7 +463,9 @@ void userinit(void)
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
+// Grow or shrink user memory by n bytes. Growing only moves
+// the end of the heap VMA; pages are mapped as they fault.
+// Shrinking also unmaps and frees the released pages.
 // Return 0 on success, -1 on failure.
 int growproc(long n)
 {
@@ -409,12 +473,18 @@ int growproc(long n)
   struct proc *p = myproc();
   uint64 va_begin = p->heap_vma->va_begin;
   uint64 va_end = p->heap_vma->va_end;
+  uint64 old_end = va_end;
   va_end += n;
 
   sz = max_addr_in_memory_areas(p);
   if (va_begin <= va_end && (va_end - va_begin < HEAP_THRESHOLD))
   {
+    acquire(&p->vma_lock);
     p->heap_vma->va_end = va_end;
+    if (PGROUNDUP(va_end) < PGROUNDUP(old_end))
+      p->rss -= uvmunmap(p->pagetable, PGROUNDUP(va_end),
+                         PGROUNDUP(old_end) - PGROUNDUP(va_end), 1);
+    release(&p->vma_lock);
   }
   else if (n < 0)
   {
@@ -452,6 +522,7 @@ int fork(void)
     release(&np->lock);
     return -1;
   }
+  np->rss = p->rss;
   // np->sz = p->sz;
 
   np->parent = p;
@@ -532,6 +603,7 @@ void exit(int status)
 
   begin_op(ROOTDEV);
   iput(p->cwd);
+  vma_iput(p->memory_areas);
   end_op(ROOTDEV);
   p->cwd = 0;
 
@@ -669,7 +741,12 @@ void scheduler(void)
         // before jumping back to us.
         p->state = RUNNING;
         c->proc = p;
+        p->vdso->cpu = cpuid();
+        TRACE(TR_RUN, p->pid, 0);
+        p->tstamp = r_time();
         swtch(&c->scheduler, &p->context);
+        p->stime += r_time() - p->tstamp;
+        TRACE(TR_STOP, p->pid, p->state);
 
         // Process is done running for now.
         // It should have changed its p->state before coming back.
@@ -748,6 +825,91 @@ void forkret(void)
   usertrapret();
 }
 
+// A kernel thread's first scheduling by scheduler()
+// will swtch to kthreadret.
+// A spawned child's very first scheduling by scheduler()
+// will swtch to spawnret.
+static void spawnret(void)
+{
+  struct proc *p = myproc();
+  char **v = (char **)p->spawnbuf;
+  int argc;
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  argc = exec(v[0], v + 1);
+  kfree(p->spawnbuf);
+  p->spawnbuf = 0;
+  if (argc < 0)
+    exit(SPAWN_EXECFAILED);
+
+  p->tf->a0 = argc;
+  usertrapret();
+}
+
+// Create a child that runs the program in buf, a page laid out
+// by sys_spawn, with open files ofile. Nothing of the caller's
+// memory is copied: the child does the exec itself when it first
+// runs. On success, buf and the references in ofile belong to the
+// child. Returns the child's pid, or -1.
+int spawn(char *buf, struct file **ofile)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if ((np = allocproc()) == 0)
+    return -1;
+
+  np->parent = p;
+  for (i = 0; i < NOFILE; i++)
+    np->ofile[i] = ofile[i];
+  np->cwd = idup(p->cwd);
+  np->spawnbuf = buf;
+  np->context.ra = (uint64)spawnret;
+  safestrcpy(np->name, p->name, sizeof(p->name));
+  pid = np->pid;
+
+  np->state = RUNNABLE;
+
+  release(&np->lock);
+
+  return pid;
+}
+
+static void kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn(p->karg);
+  panic("kthread returned");
+}
+
+// Start a kernel thread running fn(arg). It has a process
+// slot, so it can sleep, but it never enters user space and
+// fn must not return. Returns 0, or -1 if no proc is free.
+int kthread(char *name, void (*fn)(void *), void *arg)
+{
+  struct proc *p;
+
+  if ((p = allocproc()) == 0)
+    return -1;
+
+  p->context.ra = (uint64)kthreadret;
+  p->kfn = fn;
+  p->karg = arg;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->cmd = strdup(name);
+  p->state = RUNNABLE;
+
+  release(&p->lock);
+  return 0;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void sleep(void *chan, struct spinlock *lk)
@@ -838,6 +1000,158 @@ int kill(int pid)
   return -1;
 }
 
+// Copy out the system call counts and times of the process
+// with the given pid (see scstat in syscall.c).
+int proc_sccount(int pid, uint64 *count, uint64 *cycles)
+{
+  struct proc *p;
+
+  for (p = proc; p < &proc[NPROC]; p++)
+  {
+    acquire(&p->lock);
+    if (p->pid == pid && p->state != UNUSED)
+    {
+      memmove(count, p->sccount, sizeof(p->sccount));
+      memmove(cycles, p->sccycles, sizeof(p->sccycles));
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+// Copy out the resource usage of up to n processes to the
+// user array pi. Returns the number copied, or -1.
+int procinfo(uint64 pi, int n)
+{
+  struct proc *p;
+  struct procinfo info;
+  int i = 0;
+
+  for (p = proc; p < &proc[NPROC] && i < n; p++)
+  {
+    acquire(&p->lock);
+    if (p->state == UNUSED)
+    {
+      release(&p->lock);
+      continue;
+    }
+    memset(&info, 0, sizeof(info));
+    info.pid = p->pid;
+    info.ppid = p->parent ? p->parent->pid : 0;
+    info.state = p->state;
+    info.priority = p->priority;
+    safestrcpy(info.name, p->name, sizeof(info.name));
+    info.utime = p->utime;
+    info.stime = p->stime;
+    info.minflt = p->minflt;
+    info.majflt = p->majflt;
+    info.rss = p->rss;
+    info.inblock = p->inblock;
+    info.oublock = p->oublock;
+    release(&p->lock);
+    if (copyout(myproc()->pagetable, pi + i * sizeof(info), (char *)&info, sizeof(info)) < 0)
+      return -1;
+    i++;
+  }
+  return i;
+}
+
+// The process with the given pid, locked, or 0.
+static struct proc *lockproc(int pid)
+{
+  struct proc *p;
+
+  for (p = proc; p < &proc[NPROC]; p++)
+  {
+    acquire(&p->lock);
+    if (p->pid == pid && p->state != UNUSED)
+      return p;
+    release(&p->lock);
+  }
+  return 0;
+}
+
+// The pid of the process in slot i of the process table,
+// or 0 if the slot is unused (for listing /proc).
+int procpid(int i)
+{
+  struct proc *p = &proc[i];
+  int pid;
+
+  acquire(&p->lock);
+  pid = p->state == UNUSED ? 0 : p->pid;
+  release(&p->lock);
+  return pid;
+}
+
+// Text of /proc/<pid>/status, or -1 if there is no such
+// process. Times are in milliseconds.
+int procstatus(int pid, char *buf, int n)
+{
+  static char *states[] = {[UNUSED] "unused", [SLEEPING] "sleeping",
+                           [RUNNABLE] "runnable", [RUNNING] "running",
+                           [ZOMBIE] "zombie"};
+  struct proc *p;
+  uint64 calls;
+  int i, len;
+
+  if ((p = lockproc(pid)) == 0)
+    return -1;
+  calls = 0;
+  for (i = 0; i < NSYSCALL; i++)
+    calls += p->sccount[i];
+  len = snprintf(buf, n, "Name:\t%s\nState:\t%s\nPid:\t%d\nPPid:\t%d\nPriority:\t%d\n",
+                 p->name, states[p->state], p->pid,
+                 p->parent ? p->parent->pid : 0, p->priority);
+  len += snprintf(buf + len, n - len, "Rss:\t%d kB\nMinFlt:\t%d\nMajFlt:\t%d\n",
+                  (int)(p->rss * (PGSIZE / 1024)), (int)p->minflt, (int)p->majflt);
+  len += snprintf(buf + len, n - len, "InBlock:\t%d\nOuBlock:\t%d\n",
+                  (int)p->inblock, (int)p->oublock);
+  len += snprintf(buf + len, n - len, "UTime:\t%d ms\nSTime:\t%d ms\nSyscalls:\t%d\n",
+                  (int)(p->utime / (MTIME_HZ / 1000)),
+                  (int)(p->stime / (MTIME_HZ / 1000)), (int)calls);
+  release(&p->lock);
+  return len;
+}
+
+// Text of /proc/<pid>/maps: the VMAs of the process, or -1
+// if there is no such process.
+int procmaps(int pid, char *buf, int n)
+{
+  struct proc *p;
+  struct vma *ma;
+  int len;
+
+  if ((p = lockproc(pid)) == 0)
+    return -1;
+  len = 0;
+  acquire(&p->vma_lock);
+  for (ma = p->memory_areas; ma; ma = ma->next)
+    len += format_memory_area(p, ma, buf + len, n - len);
+  release(&p->vma_lock);
+  release(&p->lock);
+  return len;
+}
+
+// Text of /proc/<pid>/pagetable: the pages the process's
+// page table maps, or -1 if there is no such process. exec
+// swaps page tables under vma_lock.
+int procpagetable(int pid, char *buf, int n)
+{
+  struct proc *p;
+  int len;
+
+  if ((p = lockproc(pid)) == 0)
+    return -1;
+  acquire(&p->vma_lock);
+  len = p->pagetable ? vmsprint(p->pagetable, buf, n) : 0;
+  release(&p->vma_lock);
+  release(&p->lock);
+  return len;
+}
+
 // Copy to either a user address, or kernel address,
 // depending on usr_dst.
 // Returns 0 on success, -1 on error.
@@ -885,7 +1199,7 @@ void procdump(void)
   struct proc *p;
   char *state;
 
-  printf("\nPID\tPPID\tPRIO\tSTATE\tCMD\n");
+  printf_no_lock("\nPID\tPPID\tPRIO\tSTATE\tCMD\n");
   for (p = proc; p < &proc[NPROC]; p++)
   {
     if (p->state == UNUSED)
@@ -894,10 +1208,10 @@ void procdump(void)
       state = states[p->state];
     else
       state = "???";
-    printf("%d\t%d\t%d\t%s (epc=%p)\t'%s'", p->pid,
-           p->parent ? p->parent->pid : -1, p->priority, state, p->tf->epc,
-           p->cmd);
-    printf("\n");
+    printf_no_lock("%d\t%d\t%d\t%s (epc=%p)\t'%s'", p->pid,
+                   p->parent ? p->parent->pid : -1, p->priority, state,
+                   p->tf->epc, p->cmd);
+    printf_no_lock("\n");
   }
 }
 
@@ -907,13 +1221,13 @@ void priodump(void)
   for (int i = 0; i < NPRIO; i++)
   {
     struct list_proc *l = prio[i];
-    printf("Priority queue for priority = %d: ", i);
+    printf_no_lock("Priority queue for priority = %d: ", i);
     while (l)
     {
-      printf("%d ", l->p->pid);
+      printf_no_lock("%d ", l->p->pid);
       l = l->next;
     }
-    printf("\n");
+    printf_no_lock("\n");
   }
 }
 
@@ -98,16 +98,21 @@ struct vma {
   uint64 va_end;
 
   /* Éventuellement, cette VMA peut être peuplée par le contenu d'un fichier. Si
-   * c'est le cas, [file] donne le nom du fichier, [file_offset] le déplacement
-   * dans le fichier, et [file_nbytes] le nombre d'octets à lire dans le
-   * fichier.
+   * c'est le cas, [ip] est l'inode du fichier (la VMA en tient une référence),
+   * [file_offset] le déplacement dans le fichier, et [file_nbytes] le nombre
+   * d'octets à lire dans le fichier.
    *
-   * Par exemple, si [file_offset] vaut 0x300, [file_nbytes] vaut 0x60, [file]
-   * vaut "toto", [va_begin] vaut 0x1000 et [va_end] vaut 0x1fff, alors on
-   * chargera les octets 0x300-0x35f aux adresses virtuelles 0x1000-0x105f, et
-   * les adresses virtuelles 0x1060-0x1fff seront remplies de 0.
+   * Par exemple, si [file_offset] vaut 0x300, [file_nbytes] vaut 0x60, [ip]
+   * est l'inode de "toto", [va_begin] vaut 0x1000 et [va_end] vaut 0x1fff,
+   * alors on chargera les octets 0x300-0x35f aux adresses virtuelles
+   * 0x1000-0x105f, et les adresses virtuelles 0x1060-0x1fff seront remplies
+   * de 0.
+   *
+   * Les pages d'une VMA sans VMA_W qui viennent du fichier sont partagées
+   * entre processus (voir textcache.c) ; celles d'une VMA avec VMA_W sont
+   * privées, et partagées en copie sur écriture après un fork.
    */
-  char* file;
+  struct inode* ip;
   uint64 file_offset;
   uint64 file_nbytes;
 
@@ -123,8 +128,10 @@ struct vma* add_memory_area(struct proc*, uint64, uint64);
 struct vma* get_memory_area(struct proc*, uint64);
 void print_memory_areas(struct proc*);
 void print_memory_area(struct proc*, struct vma*);
+int format_memory_area(struct proc*, struct vma*, char*, int);
 uint64 max_addr_in_memory_areas(struct proc*);
 void free_vma(struct vma*);
+void vma_iput(struct vma*);
 
 enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
@@ -151,11 +158,29 @@ struct proc {
   struct vma * heap_vma;       // Une VMA particulière pour le tas
   pagetable_t pagetable;       // Page table
   struct trapframe *tf;        // data page for trampoline.S
+  struct vdsoproc *vdso;       // page mapped read-only at VDSO_PROC
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
   char* cmd;
+  uint exectick;               // ticks at the last exec
+  char *spawnbuf;              // Program to exec on first run (see spawn)
+  uint64 sccount[NSYSCALL];    // system calls made, by number
+  uint64 sccycles[NSYSCALL];   // and the time they took
+
+  // Resource usage (see procinfo).
+  uint64 utime;                // cycles run in user mode
+  uint64 stime;                // cycles run in the kernel
+  uint64 tstamp;               // when utime or stime was last updated
+  uint64 minflt;               // pages mapped without reading a file
+  uint64 majflt;               // pages read from a file
+  uint64 rss;                  // user pages mapped
+  uint64 inblock;              // disk blocks read
+  uint64 oublock;              // disk blocks written
+
+  void (*kfn)(void*);          // Kernel thread body (see kthread)
+  void *karg;
 };
 
 struct list_proc {
@@ -0,0 +1,314 @@
+// /proc: a read-only pseudo-filesystem of kernel statistics.
+//
+//   /proc/meminfo, buddyinfo, locks, bcache
+//   /proc/<pid>/status, maps, pagetable   (<pid> may be "self")
+//
+// openfile() hands paths under /proc to procfsopen() instead
+// of looking them up on disk; the disk's /proc is an empty
+// directory that only marks the mount point. Relative paths
+// are recognized from the root directory and from the disk's
+// /proc, so that "cd /proc; cat meminfo" works.
+//
+// A file's text is generated by the module that owns the
+// data (see meminfo in kalloc.c, procstatus in proc.c, ...)
+// when the file is read at offset 0, into a buffer belonging
+// to the open file; later reads continue through that
+// snapshot. Reopen the file, or lseek it to 0, to sample
+// again. The buffer starts at a page and doubles while the
+// text fills it; text longer than PROCFSBUF is cut short.
+
+#include "types.h"
+#include "param.h"
+#include "stat.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "riscv.h"
+#include "defs.h"
+#include "proc.h"
+
+static struct {
+  char *name;
+  int (*gen)(char*, int);
+} globals[] = {
+  { "meminfo",   meminfo },
+  { "buddyinfo", buddyinfo },
+  { "locks",     lockinfo },
+  { "bcache",    bcacheinfo },
+};
+
+static struct {
+  char *name;
+  int (*gen)(int, char*, int);
+} pidfiles[] = {
+  { "status",    procstatus },
+  { "maps",      procmaps },
+  { "pagetable", procpagetable },
+};
+
+// Is ip the disk's /proc directory?
+static int
+isprocdir(struct inode *ip)
+{
+  struct inode *dp;
+  int r;
+
+  if(ip->dev != ROOTDEV)
+    return 0;
+  begin_op(ROOTDEV);
+  r = (dp = namei("/proc")) != 0 && dp == ip;
+  if(dp)
+    iput(dp);
+  end_op(ROOTDEV);
+  return r;
+}
+
+// If path names /proc or something in it, return the part
+// after "proc", else 0.
+char*
+procfspath(char *path)
+{
+  struct inode *cwd = myproc()->cwd;
+
+  if(*path == '/'){
+    while(*path == '/')
+      path++;
+  } else if(cwd->dev != ROOTDEV || cwd->inum != ROOTINO){
+    // Relative to /proc itself, unless going back up.
+    if(strncmp(path, "..", 2) == 0 && (path[2] == 0 || path[2] == '/'))
+      return 0;
+    return isprocdir(cwd) ? path : 0;
+  }
+  if(strncmp(path, "proc", 4) != 0 || (path[4] != 0 && path[4] != '/'))
+    return 0;
+  return path + 4;
+}
+
+// Copy the next element of path other than "." to name,
+// which is empty at the end of path and "/" (no /proc name)
+// if the element is too long. Returns the rest of path.
+static char*
+elem(char *path, char *name)
+{
+  int n;
+
+  while(*path == '/' || (*path == '.' && (path[1] == 0 || path[1] == '/')))
+    path++;
+  for(n = 0; *path && *path != '/'; path++)
+    if(n < DIRSIZ)
+      name[n++] = *path;
+  name[n] = 0;
+  if(n == DIRSIZ)
+    safestrcpy(name, "/", DIRSIZ);
+  return path;
+}
+
+// The pid named by name if that process exists, else 0.
+static int
+namepid(char *name)
+{
+  int i, pid;
+
+  if(strncmp(name, "self", DIRSIZ) == 0)
+    return myproc()->pid;
+  pid = 0;
+  for(; *name; name++){
+    if(*name < '0' || *name > '9')
+      return 0;
+    pid = pid*10 + *name - '0';
+  }
+  for(i = 0; i < NPROC && pid > 0; i++)
+    if(procpid(i) == pid)
+      return pid;
+  return 0;
+}
+
+static uint
+procfsino(int pid, int pfile)
+{
+  return 0x80000000 | pid << 8 | (pfile + 1);
+}
+
+// Open the /proc file rest names (rest as returned by
+// procfspath). /proc files can only be read.
+struct file*
+procfsopen(char *rest, int omode)
+{
+  struct file *f;
+  char name[DIRSIZ+1];
+  int pid, pfile;
+
+  if(omode != O_RDONLY)
+    return 0;
+
+  // pfile is the index in globals (pid 0) or pidfiles,
+  // or -1 for /proc and /proc/<pid>.
+  pid = 0;
+  pfile = -1;
+  rest = elem(rest, name);
+  if(*name){
+    for(pfile = 0; pfile < NELEM(globals); pfile++)
+      if(strncmp(name, globals[pfile].name, DIRSIZ) == 0)
+        break;
+    if(pfile == NELEM(globals)){
+      if((pid = namepid(name)) == 0)
+        return 0;
+      pfile = -1;
+      rest = elem(rest, name);
+      if(*name){
+        for(pfile = 0; pfile < NELEM(pidfiles); pfile++)
+          if(strncmp(name, pidfiles[pfile].name, DIRSIZ) == 0)
+            break;
+        if(pfile == NELEM(pidfiles))
+          return 0;
+      }
+    }
+    elem(rest, name);
+    if(*name)
+      return 0;
+  }
+
+  if((f = filealloc()) == 0)
+    return 0;
+  f->type = FD_PROC;
+  f->pid = pid;
+  f->pfile = pfile;
+  initsleeplock_unlisted(&f->plock, "procfs");
+  f->pbuf = 0;
+  f->plen = 0;
+  f->psize = 0;
+  f->ip = 0;
+  f->off = 0;
+  f->readable = 1;
+  f->writable = 0;
+  return f;
+}
+
+// Generate f's text into f->pbuf, growing it until the text
+// fits. Returns the length of the text, or -1. Caller holds
+// f->plock.
+static int
+procfsgen(struct file *f)
+{
+  int len;
+
+  for(;;){
+    if(f->pbuf == 0){
+      f->psize = f->psize ? f->psize : PGSIZE;
+      if((f->pbuf = bd_malloc(f->psize)) == 0)
+        return -1;
+    }
+    if(f->pid)
+      len = pidfiles[f->pfile].gen(f->pid, f->pbuf, f->psize);
+    else
+      len = globals[f->pfile].gen(f->pbuf, f->psize);
+    // A generator that ran out of room has filled the buffer
+    // but for the NUL.
+    if(len < 0 || len < f->psize - 1 || f->psize >= PROCFSBUF)
+      return len;
+    bd_free(f->pbuf);
+    f->pbuf = 0;
+    f->psize *= 2;
+  }
+}
+
+// Read from a /proc file; reading at offset 0 generates
+// its text anew. The file may be shared after fork() or
+// dup(), so the whole read holds f->plock.
+int
+procfsread(struct file *f, uint64 addr, int n)
+{
+  int len;
+
+  if(f->pfile < 0)
+    return -1;    // a directory; see procfsgetdents
+  acquiresleep(&f->plock);
+  if(f->off == 0){
+    if((len = procfsgen(f)) < 0){
+      releasesleep(&f->plock);
+      return -1;  // out of memory, or the process has gone
+    }
+    f->plen = len;
+  }
+  if(f->off >= f->plen)
+    n = 0;
+  else if(n > f->plen - f->off)
+    n = f->plen - f->off;
+  if(n > 0 && copyout(myproc()->pagetable, addr, f->pbuf + f->off, n) < 0)
+    n = -1;
+  else
+    f->off += n;
+  releasesleep(&f->plock);
+  return n;
+}
+
+// Get metadata about a /proc file. Its size is that of the
+// text last generated.
+int
+procfsstat(struct file *f, uint64 addr)
+{
+  struct stat st;
+
+  st.dev = NDISK;   // not a disk
+  st.ino = procfsino(f->pid, f->pfile);
+  st.type = f->pfile < 0 ? T_DIR : T_FILE;
+  st.nlink = 1;
+  acquiresleep(&f->plock);
+  st.size = f->plen;
+  releasesleep(&f->plock);
+  return copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st));
+}
+
+// Copy up to n entries of a /proc directory to user address
+// dst as struct dirstats, as dirstats() in fs.c. f->off is
+// the index of the next entry: the global files, then one
+// per process table slot.
+int
+procfsgetdents(struct file *f, uint64 dst, int n)
+{
+  struct dirstat ds;
+  int i, pid;
+
+  if(f->pfile >= 0)
+    return -1;
+  acquiresleep(&f->plock);
+  for(i = 0; i < n; f->off++){
+    memset(&ds, 0, sizeof(ds));
+    ds.nlink = 1;
+    ds.type = T_FILE;
+    if(f->pid){
+      if(f->off >= NELEM(pidfiles))
+        break;
+      safestrcpy(ds.name, pidfiles[f->off].name, sizeof(ds.name));
+      ds.ino = procfsino(f->pid, f->off);
+    } else if(f->off < NELEM(globals)){
+      safestrcpy(ds.name, globals[f->off].name, sizeof(ds.name));
+      ds.ino = procfsino(0, f->off);
+    } else if(f->off < NELEM(globals) + NPROC){
+      if((pid = procpid(f->off - NELEM(globals))) == 0)
+        continue;
+      snprintf(ds.name, sizeof(ds.name), "%d", pid);
+      ds.ino = procfsino(pid, -1);
+      ds.type = T_DIR;
+    } else
+      break;
+    if(copyout(myproc()->pagetable, dst + i*sizeof(ds), (char*)&ds, sizeof(ds)) < 0){
+      i = -1;
+      break;
+    }
+    i++;
+  }
+  releasesleep(&f->plock);
+  return i;
+}
+
+// f is fileclose()'s copy of a file whose last reference has
+// gone, so no read or lseek can be using its buffer.
+void
+procfsclose(struct file *f)
+{
+  if(f->pbuf)
+    bd_free(f->pbuf);
+}
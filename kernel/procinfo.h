@@ -0,0 +1,22 @@
+#ifndef PROCINFO_H
+#define PROCINFO_H
+
+// What procinfo(pi, n) returns for each process.
+// Times are in time CSR counts (see vdso.h for the rate).
+
+struct procinfo {
+  int pid;
+  int ppid;
+  int state;       // enum procstate in proc.h
+  int priority;
+  char name[16];
+  uint64 utime;    // cycles run in user mode
+  uint64 stime;    // cycles run in the kernel
+  uint64 minflt;   // pages mapped without reading a file
+  uint64 majflt;   // pages read from a file
+  uint64 rss;      // user pages mapped
+  uint64 inblock;  // disk blocks read
+  uint64 oublock;  // disk blocks written
+};
+
+#endif
@@ -0,0 +1,138 @@
+// Sampling profiler.
+//
+// While it is on, the timer interrupts every hart profrate
+// times per tick instead of once, and each interrupt records
+// where the hart was into that hart's buffer; only every
+// profrate'th interrupt counts as a tick (see devintr). A
+// buffer has a single writer, its hart with interrupts off,
+// so recording takes no lock. When a buffer fills, further
+// samples are counted as dropped.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+#include "prof.h"
+
+struct profbuf {
+  struct profsample s[NPROFSAMPLE];
+  uint n;         // samples recorded
+  uint dropped;   // samples lost because s[] was full
+  int count;      // timer interrupts since the last tick
+};
+
+static struct profbuf profbuf[NCPU];
+static int profrate;          // samples per tick; 0 if off
+static struct spinlock proflock;  // serializes starting and stopping
+
+// Called on every timer interrupt, with the interrupted pc
+// still in sepc. Returns 1 if the interrupt is also a tick.
+int
+profintr(void)
+{
+  struct profbuf *b = &profbuf[cpuid()];
+  struct profsample *s;
+  struct proc *p;
+  int rate;
+
+  rate = __atomic_load_n(&profrate, __ATOMIC_RELAXED);
+  if(rate == 0){
+    b->count = 0;
+    return 1;
+  }
+
+  if(b->n < NPROFSAMPLE){
+    s = &b->s[b->n];
+    s->pc = r_sepc();
+    s->user = (r_sstatus() & SSTATUS_SPP) == 0;
+    s->cpu = cpuid();
+    p = myproc();
+    s->pid = p ? p->pid : 0;
+    __sync_synchronize();
+    b->n++;
+  } else {
+    b->dropped++;
+  }
+
+  if(++b->count < rate)
+    return 0;
+  b->count = 0;
+  return 1;
+}
+
+// Write an int to the PROF device: the new sampling rate.
+static int
+profwrite(struct file *f, int user_src, uint64 src, int n)
+{
+  struct profbuf *b;
+  int rate, dropped;
+
+  if(n != sizeof(rate) || either_copyin(&rate, user_src, src, sizeof(rate)) == -1)
+    return -1;
+  if(rate < 0 || rate > PROFMAXRATE)
+    return -1;
+
+  acquire(&proflock);
+  __atomic_store_n(&profrate, 0, __ATOMIC_RELAXED);
+  dropped = 0;
+  for(b = profbuf; b < profbuf + NCPU; b++){
+    dropped += b->dropped;
+    if(rate){
+      b->n = 0;
+      b->dropped = 0;
+    }
+  }
+  if(rate == 0 && dropped)
+    printf("prof: %d samples dropped\n", dropped);
+  // The new interval takes effect at each hart's next
+  // interrupt, so the first tick after a change is off by
+  // part of an interval.
+  timerinterval(TICKCYCLES / (rate ? rate : 1));
+  __atomic_store_n(&profrate, rate, __ATOMIC_RELAXED);
+  release(&proflock);
+  return n;
+}
+
+// Read samples: each CPU's buffer, one after another. f->off
+// is the byte offset in that sequence.
+static int
+profread(struct file *f, int user_dst, uint64 dst, int n)
+{
+  struct profbuf *b;
+  uint i, nsample, tot;
+
+  i = f->off / sizeof(struct profsample);
+  tot = 0;
+  for(b = profbuf; b < profbuf + NCPU; b++){
+    nsample = __atomic_load_n(&b->n, __ATOMIC_RELAXED);
+    __sync_synchronize();
+    if(i >= nsample){
+      i -= nsample;
+      continue;
+    }
+    for(; i < nsample && tot + sizeof(struct profsample) <= n; i++){
+      if(either_copyout(user_dst, dst + tot, &b->s[i], sizeof(struct profsample)) == -1)
+        return -1;
+      tot += sizeof(struct profsample);
+    }
+    if(tot + sizeof(struct profsample) > n)
+      break;
+    i = 0;
+  }
+  f->off += tot;
+  return tot;
+}
+
+void
+profinit(void)
+{
+  initlock(&proflock, "prof");
+  devsw[PROF].read = profread;
+  devsw[PROF].write = profwrite;
+}
@@ -0,0 +1,19 @@
+#ifndef PROF_H
+#define PROF_H
+
+// The sampling profiler (see prof.c). Writing an int n to the
+// PROF device starts sampling n times per tick, after clearing
+// the samples, and writing 0 stops it. Reading returns the
+// samples as struct profsample records.
+
+#define PROFMAXRATE  100   // most samples per tick
+#define NPROFSAMPLE  4096  // samples kept per CPU
+
+struct profsample {
+  uint64 pc;     // interrupted instruction
+  int pid;       // 0 if no process was running
+  short cpu;
+  short user;    // pc is a user address
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef SCSTAT_H
+#define SCSTAT_H
+
+// Per-syscall statistics, as returned by scstat(pid, st),
+// which fills st[0..NSYSCALL-1], indexed by syscall number.
+// For pid 0 they cover every process since boot; otherwise
+// only that process, and hist[] is left empty.
+
+#define NSCHIST 32
+
+struct scstat {
+  uint64 count;
+  uint64 cycles;           // time CSR counts spent in the call
+  uint64 hist[NSCHIST];    // hist[i]: calls taking [2^i, 2^(i+1)) cycles
+};
+
+#endif
@@ -18,6 +18,16 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->pid = 0;
 }
 
+// As initsleeplock, but see initlock_unlisted.
+void
+initsleeplock_unlisted(struct sleeplock *lk, char *name)
+{
+  initlock_unlisted(&lk->lk, "sleep lock");
+  lk->name = name;
+  lk->locked = 0;
+  lk->pid = 0;
+}
+
 void
 acquiresleep(struct sleeplock *lk)
 {
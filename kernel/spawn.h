@@ -0,0 +1,30 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+// File actions for spawn(). The child starts with a copy of
+// the caller's open files; the actions are applied to that
+// copy, in order, before the program runs.
+#define SPAWN_OPEN   1  // fd = open(path, omode)
+#define SPAWN_DUP2   2  // fd = a copy of fd2
+#define SPAWN_CLOSE  3  // close(fd)
+
+#define NSPAWNACT    8  // maximum actions per spawn
+
+// spawn() returns -1 if the program cannot be run (no such
+// file, not an executable, bad arguments, no free process), or
+// SPAWN_EACT(i) if file action i failed, e.g. SPAWN_OPEN could
+// not open its path. If exec fails later anyway, in the child,
+// the child exits with status SPAWN_EXECFAILED.
+#define SPAWN_EACT(i)     (-2 - (i))
+#define SPAWN_ACTNUM(r)   (-2 - (r))  // i, given r = SPAWN_EACT(i)
+#define SPAWN_EXECFAILED  127
+
+struct spawnact {
+  int op;
+  int fd;
+  int fd2;      // SPAWN_DUP2
+  int omode;    // SPAWN_OPEN
+  char *path;   // SPAWN_OPEN
+};
+
+#endif
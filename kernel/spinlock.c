@@ -7,30 +7,43 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "trace.h"
 
 #define NLOCK 1000
 
 static int nlock;
 static struct spinlock *locks[NLOCK];
+static struct spinlock lockslock = { .name = "locks" };  // protects locks[]
 
-// assumes locks are not freed
+// Initialize lk without entering it in locks[], for locks in
+// memory that is allocated and freed on demand (the icache's
+// inodes), which would otherwise fill locks[]. Their counts do
+// not show in ntas() or /proc/locks.
 void
-initlock(struct spinlock *lk, char *name)
+initlock_unlisted(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
   lk->nts = 0;
   lk->n = 0;
+}
+
+void
+initlock(struct spinlock *lk, char *name)
+{
+  initlock_unlisted(lk, name);
+  acquire(&lockslock);
   if(nlock >= NLOCK)
     panic("initlock");
   locks[nlock] = lk;
   nlock++;
+  release(&lockslock);
 }
 
-
 void dump_locks(void){
   printf_no_lock("LID\tLOCKED\tCPU\tPID\tNAME\t\tPC\n");
+  acquire(&lockslock);
   for(int i = 0; i < nlock; i++){
     if(locks[i]->locked)
       printf_no_lock("%d\t%d\t%d\t%d\t%s\t\t%p\n",
@@ -42,6 +55,7 @@ void dump_locks(void){
                      locks[i]->pc
         );
   }
+  release(&lockslock);
 }
 
 #define MAXTRIES 2000000
@@ -76,8 +90,10 @@ acquire(struct spinlock *lk)
   //   amoswap.w.aq a5, a5, (s1)
   int nbtries = 0;
   int warned = 0;
+  uint64 t0 = 0;
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0) {
-    nbtries++;
+    if(nbtries++ == 0)
+      t0 = r_time();
     if(nbtries > MAXTRIES && !warned){
       printf_no_lock("CPU %d: Blocked while acquiring %s (%p)\n", cpuid(), lk->name, lk);
       printf_no_lock("process %d (CPU %d) took it at pc=%p \n", lk->pid,
@@ -95,6 +111,8 @@ acquire(struct spinlock *lk)
   if(nbtries > MAXTRIES){
     printf_no_lock("CPU %d: Finally acquired %s (%p) after %d tries\n", cpuid(), lk->name, lk, nbtries);
   }
+  if(nbtries)
+    TRACE(TR_LOCK, (uint64)lk, r_time() - t0);
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -182,6 +200,23 @@ print_lock(struct spinlock *lk)
     printf("lock: %s: #test-and-set %d #acquire() %d\n", lk->name, lk->nts, lk->n);
 }
 
+// Text of /proc/locks: each lock acquired since boot (or
+// since ntas(0)), with its acquires and test-and-set spins.
+int
+lockinfo(char *buf, int n)
+{
+  int i, len;
+
+  len = snprintf(buf, n, "acquires\ttas\tname\n");
+  acquire(&lockslock);
+  for(i = 0; i < nlock; i++)
+    if(locks[i]->n > 0)
+      len += snprintf(buf+len, n-len, "%d\t\t%d\t%s\n",
+                      locks[i]->n, locks[i]->nts, locks[i]->name);
+  release(&lockslock);
+  return len;
+}
+
 uint64
 sys_ntas(void)
 {
@@ -191,20 +226,18 @@ sys_ntas(void)
   if (argint(0, &zero) < 0) {
     return -1;
   }
+  acquire(&lockslock);
   if(zero == 0) {
-    for(int i = 0; i < NLOCK; i++) {
-      if(locks[i] == 0)
-        break;
+    for(int i = 0; i < nlock; i++) {
       locks[i]->nts = 0;
       locks[i]->n = 0;
     }
+    release(&lockslock);
     return 0;
   }
 
   printf("=== lock kmem/bcache stats\n");
-  for(int i = 0; i < NLOCK; i++) {
-    if(locks[i] == 0)
-      break;
+  for(int i = 0; i < nlock; i++) {
     if(strncmp(locks[i]->name, "bcache", strlen("bcache")) == 0 ||
        strncmp(locks[i]->name, "kmem", strlen("kmem")) == 0) {
       tot += locks[i]->nts;
@@ -217,9 +250,7 @@ sys_ntas(void)
   // stupid way to compute top 5 contended locks
   for(int t= 0; t < 5; t++) {
     int top = 0;
-    for(int i = 0; i < NLOCK; i++) {
-      if(locks[i] == 0)
-        break;
+    for(int i = 0; i < nlock; i++) {
       if(locks[i]->nts > locks[top]->nts && locks[i]->nts < last) {
         top = i;
       }
@@ -227,5 +258,6 @@ sys_ntas(void)
     print_lock(locks[top]);
     last = locks[top]->nts;
   }
+  release(&lockslock);
   return tot;
 }
@@ -13,4 +13,14 @@ struct stat {
   uint64 size; // Size of file in bytes
 };
 
+// A directory entry with its inode's status, as returned
+// by getdents().
+struct dirstat {
+  uint ino;      // Inode number
+  short type;    // Type of file
+  short nlink;   // Number of links to file
+  uint64 size;   // Size of file in bytes
+  char name[16]; // Entry name, NUL-terminated
+};
+
 #endif
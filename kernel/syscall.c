@@ -6,6 +6,7 @@
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
+#include "scstat.h"
 
 // Fetch the uint64 at addr from the current process.
 int
@@ -110,6 +111,12 @@ extern uint64 sys_create_mutex(void);
 extern uint64 sys_acquire_mutex(void);
 extern uint64 sys_release_mutex(void);
 extern uint64 sys_dump_pagetable(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_scstat(void);
+extern uint64 sys_procinfo(void);
+extern uint64 sys_lseek(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -139,20 +146,86 @@ static uint64 (*syscalls[])(void) = {
 [SYS_acquire_mutex]  sys_acquire_mutex,
 [SYS_release_mutex]  sys_release_mutex,
 [SYS_dump_pagetable] sys_dump_pagetable,
+[SYS_fsync]   sys_fsync,
+[SYS_getdents] sys_getdents,
+[SYS_spawn]   sys_spawn,
+[SYS_scstat]  sys_scstat,
+[SYS_procinfo] sys_procinfo,
+[SYS_lseek]   sys_lseek,
 };
 
+// Time spent in each system call, per CPU so that CPUs
+// don't share counters; a CPU updates its own with interrupts
+// off. Readers add them up without a lock.
+static struct scstat scstats[NCPU][NSYSCALL];
+
+static void
+scaccount(struct proc *p, int num, uint64 t)
+{
+  struct scstat *s;
+  int b;
+
+  push_off();
+  s = &scstats[cpuid()][num];
+  s->count++;
+  s->cycles += t;
+  for(b = 0; b < NSCHIST-1 && (t >> (b+1)) != 0; b++)
+    ;
+  s->hist[b]++;
+  pop_off();
+
+  p->sccount[num]++;
+  p->sccycles[num] += t;
+}
+
 void
 syscall(void)
 {
   int num;
   struct proc *p = myproc();
+  uint64 t0;
 
   num = p->tf->a7;
-  if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+  if(num > 0 && num < NELEM(syscalls) && num < NSYSCALL && syscalls[num]) {
+    t0 = r_time();
     p->tf->a0 = syscalls[num]();
+    scaccount(p, num, r_time() - t0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
     p->tf->a0 = -1;
   }
 }
+
+// scstat(pid, st): copy out NSYSCALL struct scstats, for all
+// processes if pid is 0, else for process pid.
+uint64
+sys_scstat(void)
+{
+  struct scstat s;
+  uint64 st, count[NSYSCALL], cycles[NSYSCALL];
+  int pid, num, c, i;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &st) < 0)
+    return -1;
+  if(pid != 0 && proc_sccount(pid, count, cycles) < 0)
+    return -1;
+
+  for(num = 0; num < NSYSCALL; num++){
+    memset(&s, 0, sizeof(s));
+    if(pid == 0){
+      for(c = 0; c < NCPU; c++){
+        s.count += scstats[c][num].count;
+        s.cycles += scstats[c][num].cycles;
+        for(i = 0; i < NSCHIST; i++)
+          s.hist[i] += scstats[c][num].hist[i];
+      }
+    } else {
+      s.count = count[num];
+      s.cycles = cycles[num];
+    }
+    if(copyout(myproc()->pagetable, st + num*sizeof(s), (char*)&s, sizeof(s)) < 0)
+      return -1;
+  }
+  return 0;
+}
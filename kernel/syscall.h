@@ -33,5 +33,11 @@
 #define SYS_release_mutex 26
 
 #define SYS_dump_pagetable 27
+#define SYS_fsync  28
+#define SYS_getdents 29
+#define SYS_spawn  30
+#define SYS_scstat 31
+#define SYS_procinfo 32
+#define SYS_lseek  33
 
 #endif
@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "spawn.h"
+#include "elf.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -115,6 +117,86 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+// Read up to n entries of directory fd, with their inodes'
+// type, link count and size, into an array of struct dirstat.
+// Returns the number read, 0 at the end of the directory.
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  uint64 p;
+  int n, r;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(f->readable == 0 || n < 0)
+    return -1;
+  if(f->type == FD_PROC)
+    return procfsgetdents(f, p, n);
+  if(f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  if(f->ip->type != T_DIR){
+    iunlock(f->ip);
+    return -1;
+  }
+  r = dirstats(f->ip, &f->off, p, n);
+  iunlock(f->ip);
+  return r;
+}
+
+// Move the file's offset to off bytes from the start, the
+// current offset or the end (whence SEEK_SET, SEEK_CUR or
+// SEEK_END), but not past the end. Seeking a /proc file to 0
+// makes the next read generate its text anew.
+// Returns the new offset.
+uint64
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+  uint size;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &whence) < 0)
+    return -1;
+  if(f->type == FD_INODE){
+    ilock(f->ip);
+    size = f->ip->size + f->ip->wblen;
+    iunlock(f->ip);
+  } else if(f->type == FD_PROC && f->pfile >= 0){
+    acquiresleep(&f->plock);
+    size = f->plen;
+  } else
+    return -1;
+
+  if(whence == SEEK_CUR)
+    off += f->off;
+  else if(whence == SEEK_END)
+    off += size;
+  else if(whence != SEEK_SET)
+    off = -1;
+  if(off < 0 || off > size)
+    off = -1;
+  else
+    f->off = off;
+  if(f->type == FD_PROC)
+    releasesleep(&f->plock);
+  return off;
+}
+
+// Write the file's delayed appends to the disk.
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if(f->type == FD_INODE)
+    iflush(f->ip, 0);
+  return 0;
+}
+
 // Create the path new as a link to the same inode as old.
 uint64
 sys_link(void)
@@ -185,7 +267,6 @@ uint64
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
 
@@ -215,9 +296,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -275,25 +354,35 @@ create(char *path, short type, short major, short minor)
       panic("create dots");
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  if(dirlink(dp, name, ip->inum) < 0){
+    // Directory is full: free the new inode.
+    if(type == T_DIR){
+      dp->nlink--;
+      iupdate(dp);
+    }
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    iunlockput(dp);
+    return 0;
+  }
 
   iunlockput(dp);
 
   return ip;
 }
 
-uint64
-sys_open(void)
+// Open path with omode and return a new struct file,
+// or 0 on failure.
+static struct file*
+openfile(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
   struct file *f;
   struct inode *ip;
-  int n;
+  char *rest;
 
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
+  if((rest = procfspath(path)) != 0)
+    return procfsopen(rest, omode);
 
   begin_op(ROOTDEV);
 
@@ -301,33 +390,31 @@ sys_open(void)
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
       end_op(ROOTDEV);
-      return -1;
+      return 0;
     }
   } else {
     if((ip = namei(path)) == 0){
       end_op(ROOTDEV);
-      return -1;
+      return 0;
     }
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
       end_op(ROOTDEV);
-      return -1;
+      return 0;
     }
   }
 
   if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
     iunlockput(ip);
     end_op(ROOTDEV);
-    return -1;
+    return 0;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op(ROOTDEV);
-    return -1;
+    return 0;
   }
 
   if(ip->type == T_DEVICE){
@@ -345,6 +432,25 @@ sys_open(void)
   iunlock(ip);
   end_op(ROOTDEV);
 
+  return f;
+}
+
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int fd, omode;
+  struct file *f;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+
+  if((f = openfile(path, omode)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -412,8 +518,8 @@ sys_chdir(void)
 uint64
 sys_exec(void)
 {
-  char path[MAXPATH], *argv[MAXARG];
-  int i;
+  char path[MAXPATH], *argv[MAXARG], *buf;
+  int i, n, used, ret;
   uint64 uargv, uarg;
 
   if(argstr(0, path, MAXPATH) < 0){
@@ -424,7 +530,11 @@ sys_exec(void)
     printf("sys_exec: fetch program args failed\n");
     return -1;
   }
-  memset(argv, 0, sizeof(argv));
+  // The argument strings are packed one after another
+  // into a single page.
+  if((buf = kalloc()) == 0)
+    return -1;
+  used = 0;
   for(i=0;; i++){
     if(i >= NELEM(argv)){
       goto bad;
@@ -436,25 +546,131 @@ sys_exec(void)
       argv[i] = 0;
       break;
     }
-    argv[i] = kalloc();
-    if(argv[i] == 0)
-      panic("sys_exec kalloc");
-    if(fetchstr(uarg, argv[i], PGSIZE) < 0){
+    if((n = fetchstr(uarg, buf + used, PGSIZE - used)) < 0){
       printf("sys_exec: fetchstr args failed\n");
       goto bad;
     }
+    argv[i] = buf + used;
+    used += n + 1;
   }
 
-  int ret = exec(path, argv);
+  ret = exec(path, argv);
+  kfree(buf);
+  return ret;
+
+ bad:
+  kfree(buf);
+  return -1;
+}
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+// spawn(path, argv, acts, nact): start path in a new child,
+// with the file actions acts applied to a copy of our open
+// files. The child runs the program directly; our memory is
+// never copied. Returns the child's pid.
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *buf, **v;
+  struct file *ofile[NOFILE], *f;
+  struct spawnact act;
+  struct elfhdr elf;
+  struct inode *ip;
+  struct proc *p = myproc();
+  int i, n, used, nact, pid, err;
+  uint64 uargv, uarg, uacts;
 
-  return ret;
+  if(argaddr(1, &uargv) < 0 || argaddr(2, &uacts) < 0 || argint(3, &nact) < 0)
+    return -1;
+  if(nact < 0 || nact > NSPAWNACT)
+    return -1;
+
+  // Pack the path and arguments into one page, as sys_exec
+  // does, behind an array v with v[0] the path and v+1 the
+  // argv for exec. The child execs from it (see spawnret).
+  if((buf = kalloc()) == 0)
+    return -1;
+  v = (char**)buf;
+  used = (MAXARG + 2) * sizeof(char*);
+  if((n = argstr(0, buf + used, MAXPATH)) < 0)
+    goto bad;
+  v[0] = buf + used;
+  used += n + 1;
+  for(i=0;; i++){
+    if(i >= MAXARG)
+      goto bad;
+    if(fetchaddr(uargv+sizeof(uint64)*i, &uarg) < 0)
+      goto bad;
+    if(uarg == 0){
+      v[i+1] = 0;
+      break;
+    }
+    if((n = fetchstr(uarg, buf + used, PGSIZE - used)) < 0)
+      goto bad;
+    v[i+1] = buf + used;
+    used += n + 1;
+  }
+
+  // Check for an executable here, so that the caller hears of
+  // a missing program; the child's exec looks again.
+  begin_op(ROOTDEV);
+  if((ip = namei(v[0])) == 0){
+    end_op(ROOTDEV);
+    goto bad;
+  }
+  ilock(ip);
+  n = ip->type == T_FILE && readi(ip, 0, (uint64)&elf, 0, sizeof(elf)) == sizeof(elf) &&
+      elf.magic == ELF_MAGIC;
+  iunlockput(ip);
+  end_op(ROOTDEV);
+  if(!n)
+    goto bad;
+
+  err = -1;
+  for(i = 0; i < NOFILE; i++)
+    ofile[i] = p->ofile[i] ? filedup(p->ofile[i]) : 0;
+  for(i = 0; i < nact; i++){
+    err = SPAWN_EACT(i);
+    if(copyin(p->pagetable, (char*)&act, uacts + i*sizeof(act), sizeof(act)) < 0)
+      goto badfiles;
+    if(act.fd < 0 || act.fd >= NOFILE)
+      goto badfiles;
+    switch(act.op){
+    case SPAWN_OPEN:
+      if(fetchstr((uint64)act.path, path, MAXPATH) < 0)
+        goto badfiles;
+      if((f = openfile(path, act.omode)) == 0)
+        goto badfiles;
+      break;
+    case SPAWN_DUP2:
+      if(act.fd2 < 0 || act.fd2 >= NOFILE || ofile[act.fd2] == 0)
+        goto badfiles;
+      f = filedup(ofile[act.fd2]);
+      break;
+    case SPAWN_CLOSE:
+      f = 0;
+      break;
+    default:
+      goto badfiles;
+    }
+    if(ofile[act.fd])
+      fileclose(ofile[act.fd]);
+    ofile[act.fd] = f;
+  }
+
+  err = -1;
+  if((pid = spawn(buf, ofile)) < 0)
+    goto badfiles;
+  return pid;
+
+ badfiles:
+  for(i = 0; i < NOFILE; i++)
+    if(ofile[i])
+      fileclose(ofile[i]);
+  kfree(buf);
+  return err;
 
  bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+  kfree(buf);
   return -1;
 }
 
@@ -93,12 +93,20 @@ sys_kill(void)
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return __atomic_load_n(&ticks, __ATOMIC_RELAXED);
+}
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+// procinfo(pi, n): fill pi[] with the usage of up to n
+// processes; returns how many.
+uint64
+sys_procinfo(void)
+{
+  uint64 pi;
+  int n;
+
+  if(argaddr(0, &pi) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  return procinfo(pi, n);
 }
 
 uint64
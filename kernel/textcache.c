@@ -0,0 +1,159 @@
+// Shared text pages.
+//
+// Read-only pages of program files (text, rodata) are the same
+// in every process that runs the program, so the page-fault
+// handler maps them from this cache rather than reading a
+// private copy. An entry is keyed by (dev, inum, off, n): the
+// page holds the n bytes of the file at offset off, followed by
+// zeros. The cache holds one reference to each page (see kdup);
+// every page table mapping it holds another.
+//
+// Entries are created with the inode locked, which also sets
+// ip->text. Code that changes the contents of a file (writei,
+// itrunc) calls textpurge() with the inode locked, and an inode
+// leaving the icache is purged too, so a cached page never
+// outlives the file data it was read from. Processes that
+// already map a purged page keep their copy.
+//
+// textcache.lock protects the table.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+struct textent {
+  uint dev;
+  uint inum;    // 0 if entry unused
+  uint off;
+  uint n;
+  char *pa;
+};
+
+struct {
+  struct spinlock lock;
+  struct textent ent[NTEXT];
+  int hand;     // next entry to recycle
+
+  uint hits;
+  uint misses;
+} textcache;
+
+void
+textinit(void)
+{
+  initlock(&textcache.lock, "textcache");
+}
+
+// Caller must hold textcache.lock.
+static struct textent*
+textfind(uint dev, uint inum, uint off, uint n)
+{
+  struct textent *e;
+
+  for(e = textcache.ent; e < textcache.ent+NTEXT; e++)
+    if(e->inum == inum && e->dev == dev && e->off == off && e->n == n)
+      return e;
+  return 0;
+}
+
+// Return a page holding the n bytes of ip at offset off, then
+// zeros, with a reference for the caller; 0 on error. Sets
+// *readp if the page had to be read from the file.
+// Caller must not hold ip->lock.
+char*
+textpage(struct inode *ip, uint off, uint n, int *readp)
+{
+  struct textent *e;
+  char *pa;
+
+  acquire(&textcache.lock);
+  if((e = textfind(ip->dev, ip->inum, off, n)) != 0){
+    textcache.hits++;
+    pa = e->pa;
+    kdup(pa);
+    release(&textcache.lock);
+    return pa;
+  }
+  textcache.misses++;
+  release(&textcache.lock);
+
+  if((pa = kalloc()) == 0)
+    return 0;
+  *readp = 1;
+  ilock(ip);
+  if(readi(ip, 0, (uint64)pa, off, n) != n){
+    iunlock(ip);
+    kfree(pa);
+    return 0;
+  }
+
+  acquire(&textcache.lock);
+  if((e = textfind(ip->dev, ip->inum, off, n)) != 0){
+    // Another process read the same page meanwhile.
+    kfree(pa);
+    pa = e->pa;
+  } else {
+    e = &textcache.ent[textcache.hand];
+    textcache.hand = (textcache.hand + 1) % NTEXT;
+    if(e->inum)
+      kfree(e->pa);
+    e->dev = ip->dev;
+    e->inum = ip->inum;
+    e->off = off;
+    e->n = n;
+    e->pa = pa;
+    ip->text = 1;
+  }
+  kdup(pa);
+  release(&textcache.lock);
+  iunlock(ip);
+  return pa;
+}
+
+// Drop the cached pages of ip, and forget which of them the
+// program touched at startup (see exec).
+// Caller must hold ip->lock, or ip must be unreferenced.
+void
+textpurge(struct inode *ip)
+{
+  struct textent *e;
+
+  ip->wsmap = 0;
+  if(!ip->text)
+    return;
+  acquire(&textcache.lock);
+  for(e = textcache.ent; e < textcache.ent+NTEXT; e++){
+    if(e->inum == ip->inum && e->dev == ip->dev){
+      kfree(e->pa);
+      e->inum = 0;
+    }
+  }
+  ip->text = 0;
+  release(&textcache.lock);
+}
+
+// Free the cached pages that no process maps.
+// Returns the number freed.
+int
+textreclaim(void)
+{
+  struct textent *e;
+  int n;
+
+  n = 0;
+  acquire(&textcache.lock);
+  for(e = textcache.ent; e < textcache.ent+NTEXT; e++){
+    if(e->inum && krefs(e->pa) == 1){
+      kfree(e->pa);
+      e->inum = 0;
+      n++;
+    }
+  }
+  release(&textcache.lock);
+  return n;
+}
@@ -0,0 +1,112 @@
+// Tracepoints.
+//
+// TRACE(ev, a, b), placed in the scheduler, page-fault, buffer
+// cache, disk, log and spinlock code, appends a record with a
+// timestamp to a ring belonging to the CPU it runs on. While
+// tracing is off, a tracepoint costs one load and a branch.
+// Like the kernel log (see klog.c), each ring has one writer,
+// its CPU with interrupts off, and needs no lock; w counts the
+// records ever written.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+#include "trace.h"
+
+struct tracering {
+  struct tracerec r[NTRACE];
+  uint64 w;
+};
+
+static struct tracering tracering[NCPU];
+int traceon;
+
+// Called through TRACE().
+void
+trace(int ev, uint64 a, uint64 b)
+{
+  struct tracering *t;
+  struct tracerec *r;
+  struct proc *p;
+
+  push_off();
+  t = &tracering[cpuid()];
+  r = &t->r[t->w % NTRACE];
+  r->time = r_time();
+  r->a = a;
+  r->b = b;
+  r->ev = ev;
+  r->cpu = cpuid();
+  p = mycpu()->proc;
+  r->pid = p ? p->pid : 0;
+  __sync_synchronize();
+  t->w++;
+  pop_off();
+}
+
+static int
+tracewrite(struct file *f, int user_src, uint64 src, int n)
+{
+  struct tracering *t;
+  int on;
+
+  if(n != sizeof(on) || either_copyin(&on, user_src, src, sizeof(on)) == -1)
+    return -1;
+  if(on){
+    __atomic_store_n(&traceon, 0, __ATOMIC_RELAXED);
+    for(t = tracering; t < tracering + NCPU; t++)
+      t->w = 0;
+    __sync_synchronize();
+  }
+  __atomic_store_n(&traceon, on != 0, __ATOMIC_RELAXED);
+  return n;
+}
+
+// Read records: each CPU's ring, one after another. f->off
+// is the byte offset in that sequence. Records overwritten
+// while being copied are left out.
+static int
+traceread(struct file *f, int user_dst, uint64 dst, int n)
+{
+  struct tracering *t;
+  uint64 w, len, i, skip;
+  int tot;
+
+  skip = f->off / sizeof(struct tracerec);
+  tot = 0;
+  for(t = tracering; t < tracering + NCPU; t++){
+    w = t->w;
+    __sync_synchronize();
+    len = w < NTRACE ? w : NTRACE;
+    if(skip >= len){
+      skip -= len;
+      continue;
+    }
+    for(i = w - len + skip; i < w && tot + sizeof(struct tracerec) <= n; i++){
+      if(either_copyout(user_dst, dst + tot, &t->r[i % NTRACE], sizeof(struct tracerec)) == -1)
+        return -1;
+      __sync_synchronize();
+      if(t->w - i <= NTRACE)
+        tot += sizeof(struct tracerec);
+    }
+    if(i < w)
+      break;
+    skip = 0;
+  }
+  f->off += tot;
+  return tot;
+}
+
+void
+traceinit(void)
+{
+  devsw[KTRACE].read = traceread;
+  devsw[KTRACE].write = tracewrite;
+}
@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Tracepoints (see trace.c). Writing an int to the KTRACE
+// device turns tracing on (1), after emptying the rings, or
+// off (0). Reading returns struct tracerec records, each
+// CPU's oldest first, one CPU after another.
+
+#define NTRACE  2048   // records kept per CPU
+
+// Events, and what a and b hold. Events with a duration are
+// recorded when they end; b is then the duration in cycles.
+#define TR_RUN      1  // scheduler runs a process: a = pid
+#define TR_STOP     2  // the process gave the CPU back: a = pid, b = its state
+#define TR_FAULT    3  // page fault: a = address, b = duration
+#define TR_BGET     4  // buffer cache lookup: a = block, b = 1 if hit
+#define TR_DISKRW   5  // disk request submitted: a = block, b = 1 if write
+#define TR_DISKDONE 6  // disk request completed: a = block
+#define TR_COMMIT   7  // log commit: a = blocks, b = duration
+#define TR_LOCK     8  // contended spinlock: a = lock address, b = wait
+
+struct tracerec {
+  uint64 time;   // time CSR
+  uint64 a;
+  uint64 b;
+  ushort ev;
+  ushort cpu;
+  int pid;       // 0 if no process was running
+};
+
+#endif
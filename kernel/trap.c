@@ -6,6 +6,7 @@
 #include "proc.h"
 #include "defs.h"
 #include "watchdog.h"
+#include "trace.h"
 
 struct spinlock tickslock;
 uint ticks;
@@ -34,11 +35,13 @@ void trapinithart(void)
 int handle_page_fault(struct proc *p, uint64 scause, uint64 stval, uint64 sepc)
 {
   uint64 addr = PGROUNDDOWN(stval);
+  uint64 t0 = r_time();
   acquire(&p->vma_lock);
   printf("handle_page_fault pid=%d (%s), scause=%p, stval=%p, sepc=%p\n", p->pid, p->name, scause, stval, sepc);
   // proc_vmprint(p);
   int flags = do_allocate(p->pagetable, p, addr, scause);
   release(&p->vma_lock);
+  TRACE(TR_FAULT, stval, r_time() - t0);
   if (flags < 0)
   {
     if (flags == ENOVMA)
@@ -91,6 +94,9 @@ void usertrap(void)
   // save user program counter.
   p->tf->epc = r_sepc();
 
+  p->utime += r_time() - p->tstamp;
+  p->tstamp = r_time();
+
   uint64 scause = r_scause();
 
   if (scause == 8)
@@ -150,6 +156,9 @@ void usertrapret(void)
   // now from kerneltrap() to usertrap().
   intr_off();
 
+  p->stime += r_time() - p->tstamp;
+  p->tstamp = r_time();
+
   // send syscalls, interrupts, and exceptions to trampoline.S
   w_stvec(TRAMPOLINE + (uservec - trampoline));
 
@@ -215,16 +224,14 @@ void kerneltrap()
 
 void clockintr()
 {
-  acquire(&watchdog_lock);
+  watchdogcheck();
+  // tickslock is only needed for sleep(&ticks); readers of
+  // ticks alone don't take it.
   acquire(&tickslock);
-  if (watchdog_time && ticks - watchdog_value > watchdog_time)
-  {
-    panic("watchdog !!!");
-  }
-  ticks++;
+  __atomic_store_n(&ticks, ticks + 1, __ATOMIC_RELAXED);
+  vdsotick();
   wakeup(&ticks);
   release(&tickslock);
-  release(&watchdog_lock);
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -268,6 +275,15 @@ int devintr()
     // software interrupt from a machine-mode timer interrupt,
     // forwarded by timervec in kernelvec.S.
 
+    // while the profiler is on, only some timer interrupts
+    // are ticks.
+    if (!profintr())
+    {
+      w_sip(r_sip() & ~2);
+      return 1;
+    }
+
+    watchdoghart();
     if (cpuid() == 0)
     {
       clockintr();
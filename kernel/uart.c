@@ -27,12 +27,35 @@
 #define LCR 3 // line control register
 #define LSR 5 // line status register
 
+#define IER_RX_ENABLE (1<<0)
+#define IER_TX_ENABLE (1<<1)
+#define LSR_RX_READY (1<<0)   // input is waiting to be read from RHR
+#define LSR_TX_IDLE (1<<5)    // THR can accept another character to send
+
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
+// the transmit output buffer. uartstart() moves bytes from
+// it to the UART whenever THR is empty, from the transmit
+// interrupt (IER_TX_ENABLE) or from the writer itself.
+#define UART_TX_BUF_SIZE 256
+struct {
+  struct spinlock lock;
+  char buf[UART_TX_BUF_SIZE];
+  uint64 w; // write next to buf[w % UART_TX_BUF_SIZE]
+  uint64 r; // read next from buf[r % UART_TX_BUF_SIZE]
+  int waiting; // writers sleeping in uartwrite()
+} uart_tx;
+
+extern volatile int panicked; // from printf.c
+
+static void uartstart(void);
+
 void
 uartinit(void)
 {
+  initlock(&uart_tx.lock, "uart");
+
   // disable interrupts.
   WriteReg(IER, 0x00);
 
@@ -52,26 +75,94 @@ uartinit(void)
   // reset and enable FIFOs.
   WriteReg(FCR, 0x07);
 
-  // enable receive interrupts.
-  WriteReg(IER, 0x01);
+  // enable transmit and receive interrupts.
+  WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
+}
+
+// add n characters to the output buffer, and tell the
+// UART to start sending if it isn't already. sleeps while
+// the buffer is full, so it must not be called with any
+// other lock held, or from interrupts.
+void
+uartwrite(char *s, int n)
+{
+  int i;
+
+  acquire(&uart_tx.lock);
+  for(i = 0; i < n; i++){
+    while(uart_tx.w == uart_tx.r + UART_TX_BUF_SIZE){
+      // buffer is full; wait for uartstart() to open up space.
+      uart_tx.waiting++;
+      sleep(&uart_tx.r, &uart_tx.lock);
+      uart_tx.waiting--;
+    }
+    uart_tx.buf[uart_tx.w++ % UART_TX_BUF_SIZE] = s[i];
+    uartstart();
+  }
+  release(&uart_tx.lock);
 }
 
-// write one output character to the UART.
+// add a character to the output buffer without sleeping,
+// for kernel printf() and input echo, which may run with
+// locks held or in interrupt handlers. if the buffer is
+// full, wait for the UART to take a character.
 void
 uartputc(int c)
+{
+  acquire(&uart_tx.lock);
+  if(panicked){
+    for(;;)
+      ;
+  }
+  while(uart_tx.w == uart_tx.r + UART_TX_BUF_SIZE){
+    while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+      ;
+    uartstart();
+  }
+  uart_tx.buf[uart_tx.w++ % UART_TX_BUF_SIZE] = c;
+  uartstart();
+  release(&uart_tx.lock);
+}
+
+// write a character straight to the UART, busy-waiting and
+// taking no locks. only for panic(), which may have
+// interrupted a holder of uart_tx.lock.
+void
+uartputc_sync(int c)
 {
   // wait for Transmit Holding Empty to be set in LSR.
-  while((ReadReg(LSR) & (1 << 5)) == 0)
+  while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
     ;
   WriteReg(THR, c);
 }
 
+// if the UART is idle, and a character is waiting in the
+// output buffer, send it. wakes writers waiting for space.
+// caller must hold uart_tx.lock.
+static void
+uartstart(void)
+{
+  while(uart_tx.w != uart_tx.r){
+    if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
+      // the UART transmit holding register is full,
+      // so we cannot give it another byte.
+      // it will interrupt when it's ready for a new byte.
+      return;
+    }
+    WriteReg(THR, uart_tx.buf[uart_tx.r++ % UART_TX_BUF_SIZE]);
+    // printf() gets here long before there are processes,
+    // so only call wakeup() if someone is waiting.
+    if(uart_tx.waiting)
+      wakeup(&uart_tx.r);
+  }
+}
+
 // read one input character from the UART.
 // return -1 if none is waiting.
 int
 uartgetc(void)
 {
-  if(ReadReg(LSR) & 0x01){
+  if(ReadReg(LSR) & LSR_RX_READY){
     // input data is ready.
     return ReadReg(RHR);
   } else {
@@ -79,7 +170,8 @@ uartgetc(void)
   }
 }
 
-// trap.c calls here when the uart interrupts.
+// trap.c calls here when the uart interrupts, because
+// input has arrived or the UART is ready for more output.
 void
 uartintr(void)
 {
@@ -89,4 +181,9 @@ uartintr(void)
       break;
     consoleintr(c);
   }
+
+  // send buffered characters.
+  acquire(&uart_tx.lock);
+  uartstart();
+  release(&uart_tx.lock);
 }
@@ -0,0 +1,36 @@
+// The vDSO pages.
+//
+// One page, vdsotime, is shared by every process and holds the
+// tick count, updated by clockintr(), and the scale of the time
+// CSR, which user code may read directly (start() enables it).
+// Each process also has its own page, p->vdso, holding its pid
+// and the CPU it last ran on. Both are mapped by proc_pagetable()
+// without PTE_W, and outside every VMA, like the trapframe.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "defs.h"
+#include "vdso.h"
+
+struct vdsotime *vdsotime;
+
+void
+vdsoinit(void)
+{
+  if((vdsotime = (struct vdsotime*)kalloc()) == 0)
+    panic("vdsoinit");
+  memset(vdsotime, 0, PGSIZE);
+  vdsotime->tickcycles = TICKCYCLES;
+  vdsotime->hz = MTIME_HZ;
+  vdsotime->nsshift = 8;
+  vdsotime->nsmult = (1000000000ULL << 8) / MTIME_HZ;
+}
+
+// Called by clockintr() after ticks changes.
+void
+vdsotick(void)
+{
+  __atomic_store_n(&vdsotime->ticks, ticks, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,27 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+// Pages the kernel maps read-only into every process, so that
+// user code can read the time and a few facts about itself
+// without a system call (see vdso.c and user/ulib.c). They are
+// mapped at VDSO_TIME and VDSO_PROC (see memlayout.h).
+
+struct vdsotime {
+  uint ticks;        // as returned by uptime()
+  uint tickcycles;   // time CSR counts per tick
+  uint64 hz;         // time CSR counts per second
+  uint64 nsmult;     // nanoseconds = (counts * nsmult) >> nsshift
+  uint64 nsshift;
+};
+
+struct vdsoproc {
+  int pid;
+  int cpu;           // CPU the process last ran on
+};
+
+struct timespec {
+  uint64 sec;
+  uint64 nsec;
+};
+
+#endif
@@ -16,6 +16,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "trace.h"
 
 // the address of virtio mmio register r.
 #define R(n, r) ((volatile uint32 *)(VIRTION(n) + (r)))
@@ -248,6 +249,7 @@ virtio_disk_rw(int n, struct buf *b, int write)
   disk[n].avail[1] = disk[n].avail[1] + 1;
 
   *R(n, VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  TRACE(TR_DISKRW, b->blockno, write);
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
@@ -271,6 +273,7 @@ virtio_disk_intr(int n)
     if(disk[n].info[id].status != 0)
       panic("virtio_disk_intr status");
     
+    TRACE(TR_DISKDONE, disk[n].info[id].b->blockno, 0);
     disk[n].info[id].b->disk = 0;   // disk is done with buf
     wakeup(disk[n].info[id].b);
 
@@ -4,7 +4,10 @@
 #include "elf.h"
 #include "riscv.h"
 #include "defs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
 #include "fs.h"
+#include "file.h"
 
 /*
  * the kernel's page table.
@@ -177,11 +180,13 @@ int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 
 // Remove mappings from a page table. The mappings in
 // the given range must exist. Optionally free the
-// physical memory.
-void uvmunmap(pagetable_t pagetable, uint64 va, uint64 size, int do_free)
+// physical memory. Returns the number of user pages
+// unmapped, for the callers that track p->rss.
+int uvmunmap(pagetable_t pagetable, uint64 va, uint64 size, int do_free)
 {
   uint64 a, last;
   pte_t *pte;
+  int n = 0;
 
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
@@ -195,12 +200,15 @@ void uvmunmap(pagetable_t pagetable, uint64 va, uint64 size, int do_free)
     }
     if (PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
+    if (*pte & PTE_U)
+      n++;
     if (do_free)
     {
       kfree((void *)PTE2PA(*pte));
     }
     *pte = 0;
   }
+  return n;
 }
 
 // create an empty user page table.
@@ -305,16 +313,22 @@ freewalk(pagetable_t pagetable)
 
 // Free user memory pages,
 // then free page-table pages.
-void uvmfree(pagetable_t pagetable, uint64 sz)
+// Returns the number of user pages freed.
+int uvmfree(pagetable_t pagetable, uint64 sz)
 {
-  uvmunmap(pagetable, 0, sz, 1);
+  int n = 0;
+
+  if (sz > 0)
+    n = uvmunmap(pagetable, 0, sz, 1);
   freewalk(pagetable);
+  return n;
 }
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// The physical pages are shared: read-only ones
+// as they are, writable ones copy-on-write in
+// both page tables (see do_allocate).
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
@@ -322,7 +336,6 @@ int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   pte_t *pte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
   for (i = 0; i < sz; i += PGSIZE)
   {
@@ -330,16 +343,13 @@ int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
       continue;
     if ((*pte & PTE_V) == 0)
       continue;
+    if (*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if ((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char *)pa, PGSIZE);
-    if (mappages(new, i, PGSIZE, (uint64)mem, flags) != 0)
-    {
-      kfree(mem);
+    if (mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    }
+    kdup((void *)pa);
   }
   return 0;
 
@@ -360,35 +370,34 @@ void uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
-int load_from_file(char *file,
-                   uint64 file_start_offset,
-                   uint64 pa,
-                   uint64 nbytes)
+// Make the present page at *pte, which is copy-on-write,
+// writable by this page table alone.
+static int
+cow_break(pte_t *pte)
 {
-  struct inode *ip;
-  begin_op(ROOTDEV);
-  if ((ip = namei(file)) == 0)
-  {
-    end_op(ROOTDEV);
-    return -1;
-  }
-  ilock(ip);
-  if (readi(ip, 0, pa, file_start_offset, nbytes) != nbytes)
+  char *pa = (char *)PTE2PA(*pte);
+  char *mem;
+  uint flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+
+  if (krefs(pa) > 1)
   {
-    iunlockput(ip);
-    end_op(ROOTDEV);
-    return -1;
+    if ((mem = kalloc()) == 0)
+      return ENOMEM;
+    memmove(mem, pa, PGSIZE);
+    kfree(pa);
+    pa = mem;
   }
-  iunlockput(ip);
-  end_op(ROOTDEV);
-  ip = 0;
+  *pte = PA2PTE(pa) | flags;
   return 0;
 }
 
-int do_allocate(pagetable_t pagetable, struct proc *p, uint64 addr, uint64 scause)
+// Map the page at addr for an access of kind scause. The
+// caller holds p->vma_lock. Unless prefault, count the fault
+// in p's minflt or majflt.
+static int allocate(pagetable_t pagetable, struct proc *p, uint64 addr, uint64 scause, int prefault)
 {
   pte_t *page = walk(pagetable, addr, 0);
-  void *pa;
+  char *pa;
   // Check if [addr] is present in a VMA for process [p]
   struct vma *var = get_memory_area(p, addr);
   if (var == 0)
@@ -396,11 +405,6 @@ int do_allocate(pagetable_t pagetable, struct proc *p, uint64 addr, uint64 scaus
     return ENOVMA;
   }
 
-  // if (page == 0 || !(*page & PTE_V))
-  // {
-  //   return ENOMEM;
-  // }
-
   if ((scause == CAUSE_R && !(var->vma_flags & VMA_R)) || (scause == CAUSE_W && !(var->vma_flags & VMA_W)) || (scause == CAUSE_X && !(var->vma_flags & VMA_X)))
   {
     return EBADPERM;
@@ -413,69 +417,100 @@ int do_allocate(pagetable_t pagetable, struct proc *p, uint64 addr, uint64 scaus
 
   if (page != 0 && *page & PTE_V && *page & PTE_U)
   {
+    if (scause == CAUSE_W && (*page & PTE_COW))
+    {
+      if (!prefault)
+        p->minflt++;
+      return cow_break(page);
+    }
     return 0;
   }
 
-  // Allocate a page
-  if (!(pa = kalloc()))
-    return ENOMEM;
-
   int flags = PTE_U;
   flags |= (var->vma_flags & VMA_R) != 0 ? PTE_R : 0;
   flags |= (var->vma_flags & VMA_W) != 0 ? PTE_W : 0;
   flags |= (var->vma_flags & VMA_X) != 0 ? PTE_X : 0;
 
-  // Add to pagetable
-  if (mappages(pagetable, PGROUNDDOWN(addr), PGSIZE, (uint64)pa, flags))
-  {
-    kfree(pa);
-    return EMAPFAILED;
-  }
-
-  if (var->file)
-  {
-    uint64 file_start_offset = var->file_offset;
-    uint64 nbytes = var->file_nbytes;
-
-    uint64 page_start = PGROUNDDOWN(addr);
-    uint64 page_end = page_start + PGSIZE;
-
-    if (file_start_offset >= var->file_offset + var->file_nbytes || page_end <= var->vma_start || page_start >= var->vma_end)
-    {
-      return 0;
-    }
-
-    if (file_start_offset < var->file_offset)
-    {
-      nbytes -= var->file_offset - file_start_offset;
-      file_start_offset = var->file_offset;
-    }
-
-    if (nbytes > var->file_offset + var->file_nbytes - file_start_offset)
-    {
-      nbytes = var->file_offset + var->file_nbytes - file_start_offset;
-    }
+  // The part of the page that comes from the file, if any;
+  // the rest is zero.
+  uint64 page_start = PGROUNDDOWN(addr);
+  uint64 seg_off = page_start - var->va_begin;
+  uint64 nbytes = 0;
+  if (var->ip && seg_off < var->file_nbytes)
+    nbytes = var->file_nbytes - seg_off < PGSIZE ? var->file_nbytes - seg_off : PGSIZE;
 
-    uint64 file_end_offset = file_start_offset + nbytes;
-    if (file_end_offset > var->file_offset + var->file_nbytes)
-    {
-      nbytes -= file_end_offset - (var->file_offset + var->file_nbytes);
-    }
+  struct inode *ip = var->ip;
+  uint64 off = var->file_offset + seg_off;
+  int major = 0;
 
+  if (nbytes > 0 && !(var->vma_flags & VMA_W))
+  {
+    // Read-only file pages are shared through the text cache.
     release(&p->vma_lock);
-    int res = load_from_file(var->file, file_start_offset, pa, nbytes);
+    pa = textpage(ip, off, nbytes, &major);
     acquire(&p->vma_lock);
-
-    if (res != 0)
-    {
-      kfree(pa);
+    if (pa == 0)
       return ENOFILE;
+  }
+  else
+  {
+    if (!(pa = kalloc()))
+      return ENOMEM;
+    if (nbytes > 0)
+    {
+      major = 1;
+      release(&p->vma_lock);
+      ilock(ip);
+      int n = readi(ip, 0, (uint64)pa, off, nbytes);
+      iunlock(ip);
+      acquire(&p->vma_lock);
+      if (n != nbytes)
+      {
+        kfree(pa);
+        return ENOFILE;
+      }
     }
   }
 
+  // Add to pagetable
+  if (mappages(pagetable, page_start, PGSIZE, (uint64)pa, flags))
+  {
+    kfree(pa);
+    return EMAPFAILED;
+  }
+  p->rss++;
+  if (!prefault)
+  {
+    if (major)
+      p->majflt++;
+    else
+      p->minflt++;
+  }
+
+  // Remember the program's pages touched just after exec, so
+  // that the next exec of it can map them up front. wsmap has
+  // a bit for each of the first 64 pages.
+  if (ip && ticks - p->exectick < WSTICKS && page_start < 64 * PGSIZE)
+    __sync_fetch_and_or(&ip->wsmap, 1UL << (page_start / PGSIZE));
+
   return 0;
 }
 
+int do_allocate(pagetable_t pagetable, struct proc *p, uint64 addr, uint64 scause)
+{
+  return allocate(pagetable, p, addr, scause, 0);
+}
+
+// Map the page at addr ahead of any access to it, as exec does
+// for the pages a program touched the last time it ran. No
+// fault happened, so only p->rss counts it.
+int do_prefault(pagetable_t pagetable, struct proc *p, uint64 addr)
+{
+  acquire(&p->vma_lock);
+  int r = allocate(pagetable, p, addr, CAUSE_R, 1);
+  release(&p->vma_lock);
+  return r;
+}
 
 int do_allocate_range(pagetable_t pagetable, struct proc *p, uint64 addr, uint64 len, uint64 scause)
 {
@@ -615,6 +650,40 @@ int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   }
 }
 
+// Write the leaf mappings of page table pt to buf, which has
+// room for n bytes, one "va pa flags" line each.
+// Returns the length written.
+int vmsprint(pagetable_t pt, char *buf, int n)
+{
+  int len = 0;
+
+  for (int i = 0; i < PGSIZE / sizeof(uint64); i++)
+  {
+    pte_t pgd = pt[i];
+    if ((pgd & PTE_V) == 0)
+      continue;
+    for (int j = 0; j < 512; j++)
+    {
+      pte_t pmd = ((uint64 *)(PTE2PA(pgd)))[j];
+      if ((pmd & PTE_V) == 0)
+        continue;
+      for (int k = 0; k < 512; k++)
+      {
+        pte_t pte = ((uint64 *)(PTE2PA(pmd)))[k];
+        if ((pte & PTE_V) == 0)
+          continue;
+        len += snprintf(buf + len, n - len, "%p %p %s%s%s%s\n",
+                        (uint64)((((i << 9) + j) << 9) + k) << 12, PTE2PA(pte),
+                        (pte & PTE_R) ? "r" : "-", (pte & PTE_W) ? "w" : "-",
+                        (pte & PTE_X) ? "x" : "-", (pte & PTE_U) ? "u" : "-");
+        if (len >= n - 1)
+          return len;
+      }
+    }
+  }
+  return len;
+}
+
 void vmprint(pagetable_t pt, uint64 pid, char *cmd)
 {
   printf("page table for pid=%d, cmd=%s, @%p\n", pid, cmd, pt);
@@ -1,3 +1,20 @@
+// Watchdogs.
+//
+// Each minor of the WATCHDOG device is an independent
+// watchdog. A write arms it with a timeout, the last byte
+// written, in ticks (0 disarms it), and restarts its count;
+// if it then goes longer than the timeout without another
+// write, the kernel panics. A write returns the ticks since
+// the previous one.
+//
+// A watchdog's state is one 64-bit word, timeout << 32 | tick
+// of the last write, so writers swap it atomically and the
+// clock interrupt reads it without a lock.
+//
+// The harts also watch each other: every timer interrupt
+// bumps the hart's beat count, and each hart checks that the
+// next running hart's count still moves. A hart stuck with
+// interrupts off is reported once, on the console.
 
 #include "types.h"
 #include "param.h"
@@ -11,38 +28,91 @@
 #include "proc.h"
 #include "watchdog.h"
 
-int watchdog_value;
-int watchdog_time;
-struct spinlock watchdog_lock;
+static uint64 watchdog[NWATCHDOG];
+
+struct hartwatch {
+  uint beats;    // timer interrupts taken by this hart
+  int peer;      // hart this one watches
+  uint seen;     // peer's beats when last seen to change
+  uint stale;    // own beats since then
+};
+
+static struct hartwatch hartwatch[NCPU];
+static int stuck[NCPU];   // hart has been reported
 
 int
 watchdogwrite(struct file *f, int user_src, uint64 src, int n)
 {
-  acquire(&watchdog_lock);
+  uchar time;
+  uint64 old;
 
-  int time = 0;
-  for(int i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
-      break;
-    time = c;
-  }
+  if(f->minor < 0 || f->minor >= NWATCHDOG)
+    return -1;
+  time = 0;
+  if(n > 0 && either_copyin(&time, user_src, src+n-1, 1) == -1)
+    return -1;
 
-  acquire(&tickslock);
-  n = ticks - watchdog_value;
-  watchdog_value = ticks;
-  watchdog_time = time;
-  release(&tickslock);
+  old = __atomic_exchange_n(&watchdog[f->minor],
+                            (uint64)time << 32 | __atomic_load_n(&ticks, __ATOMIC_RELAXED),
+                            __ATOMIC_RELAXED);
+  return __atomic_load_n(&ticks, __ATOMIC_RELAXED) - (uint)old;
+}
+
+// Panic if a watchdog has expired.
+// Called by clockintr() on CPU 0.
+void
+watchdogcheck(void)
+{
+  uint64 v;
+  uint timeout;
+  int i;
 
-  release(&watchdog_lock);
-  return n;
+  for(i = 0; i < NWATCHDOG; i++){
+    v = __atomic_load_n(&watchdog[i], __ATOMIC_RELAXED);
+    timeout = v >> 32;
+    if(timeout && ticks - (uint)v > timeout){
+      printf("watchdog %d expired\n", i);
+      panic("watchdog !!!");
+    }
+  }
 }
 
-void watchdoginit(){
-  initlock(&watchdog_lock, "watchdog_lock");
-  watchdog_time = 0;
+// Called on every hart's timer interrupt.
+void
+watchdoghart(void)
+{
+  struct hartwatch *h = &hartwatch[cpuid()];
+  int id, i, peer;
+  uint b;
+
+  __atomic_fetch_add(&h->beats, 1, __ATOMIC_RELAXED);
+
+  // Watch the next hart that has taken a timer interrupt.
+  id = cpuid();
+  peer = id;
+  for(i = 1; i < NCPU; i++){
+    if(__atomic_load_n(&hartwatch[(id + i) % NCPU].beats, __ATOMIC_RELAXED)){
+      peer = (id + i) % NCPU;
+      break;
+    }
+  }
+  if(peer == id)
+    return;
 
+  b = __atomic_load_n(&hartwatch[peer].beats, __ATOMIC_RELAXED);
+  if(peer != h->peer || b != h->seen){
+    h->peer = peer;
+    h->seen = b;
+    h->stale = 0;
+    return;
+  }
+  if(++h->stale == LOCKUPTICKS && __atomic_exchange_n(&stuck[peer], 1, __ATOMIC_RELAXED) == 0)
+    printf("watchdog: hart %d has taken no timer interrupt for %d ticks\n", peer, LOCKUPTICKS);
+}
 
+void
+watchdoginit(void)
+{
   devsw[WATCHDOG].read = 0;
   devsw[WATCHDOG].write = watchdogwrite;
 }
@@ -15,23 +15,33 @@
 #define static_assert(a, b) do { switch (0) case 0: case (a): ; } while (0)
 #endif
 
-#define NINODES 200
-
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
 
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
-int ninodeblocks = NINODES / IPB + 1;
+int fssize = FSSIZE;  // Size of the image in blocks (-s)
+int ninodes = 200;    // Number of inodes (-i)
+int nbitmap;
+int ninodeblocks;
 int nlog = LOGSIZE;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
-int fsfd;
+// The image is built in memory and written out in one go.
+uchar *img;
 struct superblock sb;
-char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
 
+// Entries of the directories being built; written out at the end.
+#define MAXDIRS 16
+struct dir {
+  char name[DIRSIZ];
+  uint inum;
+  struct dirent *de;
+  int n;
+  int cap;
+} dirs[MAXDIRS];
+int ndirs;
 
 void balloc(int);
 void wsect(uint, void*);
@@ -40,6 +50,10 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+uint bmapx(struct dinode *din, uint fbn);
+void wdir(uint inum, struct dirent *de, int n);
+struct dir* mkdir1(char *name);
+void addent(struct dir *d, char *name, uint inum);
 
 // convert to intel byte order
 ushort
@@ -64,79 +78,96 @@ xint(uint x)
   return y;
 }
 
+void
+usage(void)
+{
+  fprintf(stderr, "Usage: mkfs [-s blocks] [-i inodes] fs.img [-d dir] files...\n");
+  exit(1);
+}
+
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
-  uint rootino, inum, off;
-  struct dirent de;
+  int i, cc, fd, ac;
+  uint inum, off;
   char buf[BSIZE];
+  char *shortname, *p;
   struct dinode din;
+  struct dir *d, *root;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
-  if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
-    exit(1);
-  }
-
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
 
-  fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
-  if(fsfd < 0){
-    perror(argv[1]);
+  for(ac = 1; ac + 1 < argc && argv[ac][0] == '-'; ac += 2){
+    if(strcmp(argv[ac], "-s") == 0)
+      fssize = atoi(argv[ac+1]);
+    else if(strcmp(argv[ac], "-i") == 0)
+      ninodes = atoi(argv[ac+1]);
+    else
+      usage();
+  }
+  if(ac >= argc)
+    usage();
+  // dirent.inum is a ushort.
+  if(ninodes < 2 || ninodes > 65535 || fssize < 2 + nlog + 3){
+    fprintf(stderr, "mkfs: bad image size or inode count\n");
     exit(1);
   }
 
   // 1 fs block = 1 disk sector
+  nbitmap = fssize/(BSIZE*8) + 1;
+  ninodeblocks = ninodes / IPB + 1;
   nmeta = 2 + nlog + ninodeblocks + nbitmap;
-  nblocks = FSSIZE - nmeta;
+  nblocks = fssize - nmeta;
+  if(nblocks <= 0){
+    fprintf(stderr, "mkfs: image too small\n");
+    exit(1);
+  }
+
+  if((img = calloc(fssize, BSIZE)) == 0){
+    perror("calloc");
+    exit(1);
+  }
 
   sb.magic = FSMAGIC;
-  sb.size = xint(FSSIZE);
+  sb.size = xint(fssize);
   sb.nblocks = xint(nblocks);
-  sb.ninodes = xint(NINODES);
+  sb.ninodes = xint(ninodes);
   sb.nlog = xint(nlog);
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.bsize = xint(BSIZE);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d bsize %d\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, fssize, BSIZE);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
-    wsect(i, zeroes);
-
   memset(buf, 0, sizeof(buf));
   memmove(buf, &sb, sizeof(sb));
   wsect(1, buf);
 
-  rootino = ialloc(T_DIR);
-  assert(rootino == ROOTINO);
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  root = d = mkdir1(0);
+  assert(root->inum == ROOTINO);
+
+  for(i = ac+1; i < argc; i++){
+    // -d dir puts the files that follow in directory dir
+    // (created in the root); -d / goes back to the root.
+    if(strcmp(argv[i], "-d") == 0){
+      if(++i >= argc)
+        usage();
+      d = strcmp(argv[i], "/") == 0 ? root : mkdir1(argv[i]);
+      continue;
+    }
 
-  for(i = 2; i < argc; i++){
-    // get rid of "user/"
-    char *shortname;
-    if(strncmp(argv[i], "user/", 5) == 0)
-      shortname = argv[i] + 5;
-    else
-      shortname = argv[i];
-    
-    assert(index(shortname, '/') == 0);
+    // get rid of "user/" and any other leading directories
+    shortname = argv[i];
+    if((p = strrchr(shortname, '/')) != 0)
+      shortname = p + 1;
 
     if((fd = open(argv[i], 0)) < 0){
       perror(argv[i]);
@@ -151,41 +182,101 @@ main(int argc, char *argv[])
       shortname += 1;
 
     inum = ialloc(T_FILE);
+    addent(d, shortname, inum);
 
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
-
+    // Files are appended whole, one after another, so each
+    // one's blocks are contiguous.
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
 
     close(fd);
   }
 
-  // fix size of root inode dir
-  rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  for(d = dirs; d < &dirs[ndirs]; d++){
+    wdir(d->inum, d->de, d->n);
+
+    // fix size of the directory
+    rinode(d->inum, &din);
+    off = xint(din.size);
+    off = ((off + BSIZE - 1)/BSIZE) * BSIZE;
+    din.size = xint(off);
+    winode(d->inum, &din);
+  }
 
   balloc(freeblock);
 
+  // The image is built in memory and written out whole.
+  fd = open(argv[ac], O_WRONLY|O_CREAT|O_TRUNC, 0666);
+  if(fd < 0){
+    perror(argv[ac]);
+    exit(1);
+  }
+  if(write(fd, img, (size_t)fssize * BSIZE) != (ssize_t)fssize * BSIZE){
+    perror("write");
+    exit(1);
+  }
+  close(fd);
+
   exit(0);
 }
 
-void
-wsect(uint sec, void *buf)
+// Allocate a directory inode; name 0 means the root.
+// Other directories are created in the root.
+struct dir*
+mkdir1(char *name)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE){
-    perror("lseek");
+  struct dir *d;
+  struct dinode din;
+
+  for(d = dirs; name && d < &dirs[ndirs]; d++)
+    if(d != dirs && strncmp(d->name, name, DIRSIZ) == 0)
+      return d;
+  if(ndirs == MAXDIRS){
+    fprintf(stderr, "mkfs: too many directories\n");
     exit(1);
   }
-  if(write(fsfd, buf, BSIZE) != BSIZE){
-    perror("write");
+  d = &dirs[ndirs++];
+  if(name)
+    strncpy(d->name, name, DIRSIZ);
+  d->inum = ialloc(T_DIR);
+  addent(d, ".", d->inum);
+  addent(d, "..", name ? dirs[0].inum : d->inum);
+  if(name){
+    addent(&dirs[0], name, d->inum);
+    // ".." in the new directory links to the root.
+    rinode(dirs[0].inum, &din);
+    din.nlink = xshort(xshort(din.nlink) + 1);
+    winode(dirs[0].inum, &din);
+  }
+  return d;
+}
+
+void
+addent(struct dir *d, char *name, uint inum)
+{
+  struct dirent *de;
+
+  if(d->n == d->cap){
+    d->cap = d->cap ? 2 * d->cap : 64;
+    if((d->de = realloc(d->de, d->cap * sizeof(*de))) == 0){
+      perror("realloc");
+      exit(1);
+    }
+  }
+  de = &d->de[d->n++];
+  bzero(de, sizeof(*de));
+  de->inum = xshort(inum);
+  strncpy(de->name, name, DIRSIZ);
+}
+
+void
+wsect(uint sec, void *buf)
+{
+  if(sec >= fssize){
+    fprintf(stderr, "mkfs: image full\n");
     exit(1);
   }
+  memmove(img + (size_t)sec * BSIZE, buf, BSIZE);
 }
 
 void
@@ -218,14 +309,11 @@ rinode(uint inum, struct dinode *ip)
 void
 rsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE){
-    perror("lseek");
-    exit(1);
-  }
-  if(read(fsfd, buf, BSIZE) != BSIZE){
-    perror("read");
+  if(sec >= fssize){
+    fprintf(stderr, "mkfs: image full\n");
     exit(1);
   }
+  memmove(buf, img + (size_t)sec * BSIZE, BSIZE);
 }
 
 uint
@@ -234,6 +322,10 @@ ialloc(ushort type)
   uint inum = freeinode++;
   struct dinode din;
 
+  if(inum >= ninodes){
+    fprintf(stderr, "mkfs: out of inodes\n");
+    exit(1);
+  }
   bzero(&din, sizeof(din));
   din.type = xshort(type);
   din.nlink = xshort(1);
@@ -245,21 +337,54 @@ ialloc(ushort type)
 void
 balloc(int used)
 {
-  uchar buf[BSIZE];
+  uchar *bits;
   int i;
 
   printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
+  assert(used <= fssize);
+  bits = img + (size_t)xint(sb.bmapstart) * BSIZE;
   for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+    bits[i/8] = bits[i/8] | (0x1 << (i%8));
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
+  printf("balloc: wrote %d bitmap blocks at sector %d\n", nbitmap, xint(sb.bmapstart));
 }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the disk block holding block fbn of the file described
+// by din, allocating it and any index blocks on the way.
+uint
+bmapx(struct dinode *din, uint fbn)
+{
+  uint indirect[NINDIRECT];
+  uint x, level, i;
+  uint64 n;
+
+  if(fbn < NDIRECT){
+    if(xint(din->addrs[fbn]) == 0)
+      din->addrs[fbn] = xint(freeblock++);
+    return xint(din->addrs[fbn]);
+  }
+  fbn -= NDIRECT;
+  for(level = 1, n = NINDIRECT; fbn >= n; level++, n *= NINDIRECT)
+    fbn -= n;
+  if(xint(din->addrs[NDIRECT+level-1]) == 0)
+    din->addrs[NDIRECT+level-1] = xint(freeblock++);
+  x = xint(din->addrs[NDIRECT+level-1]);
+  for(; level > 0; level--){
+    n /= NINDIRECT;
+    rsect(x, (char*)indirect);
+    i = fbn / n;
+    if(indirect[i] == 0){
+      indirect[i] = xint(freeblock++);
+      wsect(x, (char*)indirect);
+    }
+    x = xint(indirect[i]);
+    fbn %= n;
+  }
+  return x;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -267,7 +392,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -276,22 +400,7 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = bmapx(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -303,3 +412,62 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+// Write the n entries de, starting with "." and "..", to the
+// empty directory inum. Uses the hashed directory format if
+// they don't fit in one block.
+void
+wdir(uint inum, struct dirent *de, int n)
+{
+  static int count[DIRH_NPTR];
+  char buf[BSIZE];
+  struct dirhdr *h;
+  struct dirent *p;
+  uint depth, nb, b, i, max;
+
+  if(n <= DPB){
+    iappend(inum, de, n * sizeof(*de));
+    return;
+  }
+
+  // Smallest table with no overflowing bucket.
+  for(depth = 1; ; depth++){
+    nb = 1U << depth;
+    if(nb > DIRH_NPTR){
+      fprintf(stderr, "mkfs: too many directory entries\n");
+      exit(1);
+    }
+    memset(count, 0, sizeof(count));
+    max = 0;
+    for(i = 2; i < n; i++){
+      b = dirhash(de[i].name) & (nb - 1);
+      if(++count[b] > max)
+        max = count[b];
+    }
+    if(max <= DPB - 1)
+      break;
+  }
+
+  // Block 0: ".", "..", header and bucket table.
+  bzero(buf, sizeof(buf));
+  memmove(buf, de, 2 * sizeof(*de));
+  h = (struct dirhdr*)buf + 2;
+  h->magic = xshort(DIRH_MAGIC);
+  h->depth = xshort(depth);
+  for(b = 0; b < nb; b++)
+    ((struct dirtab*)buf + 3 + b/DIRH_PPS)->bn[b%DIRH_PPS] = xshort(b + 1);
+  iappend(inum, buf, BSIZE);
+
+  // Bucket b is directory block b+1.
+  for(b = 0; b < nb; b++){
+    bzero(buf, sizeof(buf));
+    h = (struct dirhdr*)buf;
+    h->magic = xshort(DIRH_MAGIC);
+    h->depth = xshort(depth);
+    p = (struct dirent*)buf + 1;
+    for(i = 2; i < n; i++)
+      if((dirhash(de[i].name) & (nb - 1)) == b)
+        *p++ = de[i];
+    iappend(inum, buf, BSIZE);
+  }
+}
@@ -0,0 +1,371 @@
+// Microbenchmarks: bench [-r reps] [name...]
+//
+// Runs each named benchmark (all of them by default) once to
+// warm up, then reps times (default 5), timing each run with
+// the time CSR. Each benchmark prints one line, of
+// space-separated key=value fields after the word "bench":
+//
+//   bench name=pipe ops=256 reps=5 min_us=.. med_us=.. max_us=.. ops_per_s=.. kb_per_s=..
+//
+// ops is the number of operations in a run; the rates are
+// from the median run, and kb_per_s is there only for
+// benchmarks that move data. fork_exec runs "bench -x", which
+// exits at once.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define CYCLES_PER_US (MTIME_HZ / 1000000)
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+#define MAXREPS 50
+#define NFILEBLK 64     // blocks in the read/write benchmarks' file
+
+char *self;             // our path, for fork_exec
+char buf[BSIZE];
+uint64 seed = 1;
+
+void
+fail(char *what)
+{
+  printf("bench: %s failed\n", what);
+  exit(1);
+}
+
+int
+rand(void)
+{
+  seed = seed * 6364136223846793005L + 1442695040888963407L;
+  return (seed >> 33) & 0x7fffffff;
+}
+
+void
+forkexit(int ops)
+{
+  int i, pid;
+
+  for(i = 0; i < ops; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+}
+
+void
+forkexec(int ops)
+{
+  char *argv[] = { self, "-x", 0 };
+  int i, pid;
+
+  for(i = 0; i < ops; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0){
+      exec(self, argv);
+      fail("exec");
+    }
+    wait(0);
+  }
+}
+
+// A child writes ops blocks down a pipe to us.
+void
+pipethru(int ops)
+{
+  int i, p[2], pid;
+
+  if(pipe(p) < 0 || (pid = fork()) < 0)
+    fail("pipe");
+  if(pid == 0){
+    close(p[0]);
+    for(i = 0; i < ops; i++)
+      if(write(p[1], buf, sizeof(buf)) != sizeof(buf))
+        fail("pipe write");
+    exit(0);
+  }
+  close(p[1]);
+  while(read(p[0], buf, sizeof(buf)) > 0)
+    ;
+  close(p[0]);
+  wait(0);
+}
+
+// Touch ops fresh heap pages, one fault each. Shrinking the
+// heap unmaps the pages, so each run faults them in anew.
+void
+pagefault(int ops)
+{
+  char *p;
+  int i;
+
+  if((p = sbrk(ops * PGSIZE)) == (char*)-1)
+    fail("sbrk");
+  for(i = 0; i < ops; i++)
+    p[i * PGSIZE] = 1;
+  sbrk(-ops * PGSIZE);
+}
+
+// Grow the heap a page at a time, then give it all back;
+// nothing is touched, so no pages are mapped.
+void
+sbrkgrow(int ops)
+{
+  int i;
+
+  for(i = 0; i < ops; i++)
+    if(sbrk(PGSIZE) == (char*)-1)
+      fail("sbrk");
+  sbrk(-ops * PGSIZE);
+}
+
+void
+createunlink(int ops)
+{
+  int i, fd;
+
+  for(i = 0; i < ops; i++){
+    if((fd = open("bench.cu", O_CREATE|O_RDWR)) < 0)
+      fail("create");
+    close(fd);
+    if(unlink("bench.cu") < 0)
+      fail("unlink");
+  }
+}
+
+void
+mkfile(void)
+{
+  int i, fd;
+
+  if((fd = open("bench.dat", O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  for(i = 0; i < NFILEBLK; i++)
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  close(fd);
+}
+
+void
+rmfile(void)
+{
+  unlink("bench.dat");
+}
+
+// Write a new file of ops blocks.
+void
+seqwrite(int ops)
+{
+  int i, fd;
+
+  unlink("bench.dat");
+  if((fd = open("bench.dat", O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  for(i = 0; i < ops; i++)
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  close(fd);
+}
+
+void
+seqread(int ops)
+{
+  int i, fd;
+
+  if((fd = open("bench.dat", O_RDONLY)) < 0)
+    fail("open");
+  for(i = 0; i < ops; i++)
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("read");
+  close(fd);
+}
+
+// Read or write ops blocks of bench.dat, chosen at random.
+void
+randio(int ops, int writing)
+{
+  int i, fd, n;
+
+  if((fd = open("bench.dat", O_RDWR)) < 0)
+    fail("open");
+  for(i = 0; i < ops; i++){
+    if(lseek(fd, (rand() % NFILEBLK) * BSIZE, SEEK_SET) < 0)
+      fail("lseek");
+    n = writing ? write(fd, buf, sizeof(buf)) : read(fd, buf, sizeof(buf));
+    if(n != sizeof(buf))
+      fail(writing ? "write" : "read");
+  }
+  close(fd);
+}
+
+void
+randread(int ops)
+{
+  randio(ops, 0);
+}
+
+void
+randwrite(int ops)
+{
+  randio(ops, 1);
+}
+
+char *dirs[] = { "bench.d", "bench.d/a", "bench.d/a/b", "bench.d/a/b/c" };
+char *leaf = "bench.d/a/b/c/leaf";
+
+void
+mkdirs(void)
+{
+  int i, fd;
+
+  for(i = 0; i < NELEM(dirs); i++)
+    mkdir(dirs[i]);
+  if((fd = open(leaf, O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  close(fd);
+}
+
+void
+rmdirs(void)
+{
+  int i;
+
+  unlink(leaf);
+  for(i = NELEM(dirs) - 1; i >= 0; i--)
+    unlink(dirs[i]);
+}
+
+// Resolve a 5-deep path.
+void
+dirlookup(int ops)
+{
+  struct stat st;
+  int i;
+
+  for(i = 0; i < ops; i++)
+    if(stat(leaf, &st) < 0)
+      fail("stat");
+}
+
+// Bounce a byte between us and a child through two pipes.
+void
+pingpong(int ops)
+{
+  int i, p1[2], p2[2], pid;
+  char c = 0;
+
+  if(pipe(p1) < 0 || pipe(p2) < 0 || (pid = fork()) < 0)
+    fail("pipe");
+  if(pid == 0){
+    for(i = 0; i < ops; i++)
+      if(read(p1[0], &c, 1) != 1 || write(p2[1], &c, 1) != 1)
+        fail("pingpong");
+    exit(0);
+  }
+  for(i = 0; i < ops; i++)
+    if(write(p1[1], &c, 1) != 1 || read(p2[0], &c, 1) != 1)
+      fail("pingpong");
+  wait(0);
+  close(p1[0]);
+  close(p1[1]);
+  close(p2[0]);
+  close(p2[1]);
+}
+
+struct bench {
+  char *name;
+  int ops;                  // operations per run
+  int bytes;                // bytes moved per operation, or 0
+  void (*run)(int);
+  void (*setup)(void);      // before the warmup, or 0
+  void (*cleanup)(void);    // after the last run, or 0
+} benches[] = {
+  { "fork_exit",     100, 0,     forkexit },
+  { "fork_exec",     20,  0,     forkexec },
+  { "pipe",          256, BSIZE, pipethru },
+  { "pagefault",     256, 0,     pagefault },
+  { "sbrk",          256, 0,     sbrkgrow },
+  { "create_unlink", 50,  0,     createunlink },
+  { "seq_write",     NFILEBLK, BSIZE, seqwrite, 0, rmfile },
+  { "seq_read",      NFILEBLK, BSIZE, seqread, mkfile, rmfile },
+  { "rand_read",     NFILEBLK, BSIZE, randread, mkfile, rmfile },
+  { "rand_write",    NFILEBLK, BSIZE, randwrite, mkfile, rmfile },
+  { "dirlookup",     500, 0,     dirlookup, mkdirs, rmdirs },
+  { "ctxswitch",     500, 0,     pingpong },
+};
+
+void
+runbench(struct bench *b, int reps)
+{
+  int us[MAXREPS];
+  int i, j, t, med;
+  uint64 t0;
+
+  if(b->setup)
+    b->setup();
+  b->run(b->ops);
+  for(i = 0; i < reps; i++){
+    t0 = rdtime();
+    b->run(b->ops);
+    if((t = (rdtime() - t0) / CYCLES_PER_US) == 0)
+      t = 1;
+    for(j = i; j > 0 && us[j-1] > t; j--)
+      us[j] = us[j-1];
+    us[j] = t;
+  }
+  if(b->cleanup)
+    b->cleanup();
+
+  med = us[reps/2];
+  printf("bench name=%s ops=%d reps=%d min_us=%d med_us=%d max_us=%d ops_per_s=%d",
+         b->name, b->ops, reps, us[0], med, us[reps-1],
+         (int)((uint64)b->ops * 1000000 / med));
+  if(b->bytes)
+    printf(" kb_per_s=%d", (int)((uint64)b->ops * b->bytes / 1024 * 1000000 / med));
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bench *b;
+  int i, reps, first, found;
+
+  self = argv[0];
+  if(argc == 2 && strcmp(argv[1], "-x") == 0)
+    exit(0);
+
+  reps = 5;
+  first = 1;
+  if(argc > 2 && strcmp(argv[1], "-r") == 0){
+    reps = atoi(argv[2]);
+    first = 3;
+  }
+  if(reps < 1 || reps > MAXREPS){
+    printf("usage: bench [-r reps] [name...]\n");
+    exit(1);
+  }
+
+  for(b = benches; b < benches + NELEM(benches); b++){
+    found = first == argc;
+    for(i = first; i < argc; i++)
+      if(strcmp(argv[i], b->name) == 0)
+        found = 1;
+    if(found)
+      runbench(b, reps);
+  }
+  for(i = first; i < argc; i++){
+    for(b = benches; b < benches + NELEM(benches); b++)
+      if(strcmp(argv[i], b->name) == 0)
+        break;
+    if(b == benches + NELEM(benches))
+      printf("bench: no benchmark %s\n", argv[i]);
+  }
+  exit(0);
+}
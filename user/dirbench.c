@@ -0,0 +1,88 @@
+// Large-directory benchmark: links n names (default 10000) to
+// one file in a single directory, then looks each one up and
+// unlinks it. Prints the ticks taken by each batch of 1000
+// operations, which should stay flat as the directory grows.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define BATCH 1000
+
+char *dir = "dirbench.d";
+char *target = "dirbench.d/f";
+
+// Set buf to "dirbench.d/nN".
+void
+mkname(char *buf, int n)
+{
+  char tmp[12];
+  int i;
+
+  strcpy(buf, "dirbench.d/n");
+  i = 0;
+  do {
+    tmp[i++] = '0' + n % 10;
+    n /= 10;
+  } while(n > 0);
+  buf += strlen(buf);
+  while(i > 0)
+    *buf++ = tmp[--i];
+  *buf = '\0';
+}
+
+void
+run(char *what, int n, int op)
+{
+  char name[32];
+  struct stat st;
+  int i, r, t;
+
+  t = uptime();
+  for(i = 0; i < n; i++){
+    mkname(name, i);
+    if(op == 0)
+      r = link(target, name);
+    else if(op == 1)
+      r = stat(name, &st);
+    else
+      r = unlink(name);
+    if(r < 0){
+      printf("dirbench: %s %s failed\n", what, name);
+      exit(1);
+    }
+    if((i+1) % BATCH == 0 || i+1 == n){
+      printf("dirbench: %s %d: %d ticks\n", what, i+1, uptime() - t);
+      t = uptime();
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, fd;
+
+  n = 10000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+
+  if(mkdir(dir) < 0){
+    printf("dirbench: cannot create %s\n", dir);
+    exit(1);
+  }
+  if((fd = open(target, O_CREATE|O_RDWR)) < 0){
+    printf("dirbench: cannot create %s\n", target);
+    exit(1);
+  }
+  close(fd);
+
+  run("link", n, 0);
+  run("lookup", n, 1);
+  run("unlink", n, 2);
+
+  unlink(target);
+  unlink(dir);
+  exit(0);
+}
@@ -0,0 +1,70 @@
+// Print the kernel log, merging the per-CPU logs by tick.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+#define DMESG 3   // major number, see kernel/file.h
+#define MAXLINES 1024
+
+char buf[NCPU*KLOGSIZE+1];
+char *lines[MAXLINES];
+
+// The tick at the start of a log line, or -1 if the line
+// does not start with one (the oldest line of a ring may
+// have been partly overwritten).
+int
+tick(char *s)
+{
+  int t;
+
+  if(*s++ != '[' || *s < '0' || *s > '9')
+    return -1;
+  t = 0;
+  while(*s >= '0' && *s <= '9')
+    t = t*10 + *s++ - '0';
+  return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, n, tot, nline, i, j;
+  char *s, *p;
+
+  if((fd = open("kmsg", O_RDONLY)) < 0){
+    mknod("kmsg", DMESG, 0);
+    if((fd = open("kmsg", O_RDONLY)) < 0){
+      printf("dmesg: cannot open kmsg\n");
+      exit(1);
+    }
+  }
+  tot = 0;
+  while(tot < sizeof(buf)-1 && (n = read(fd, buf+tot, sizeof(buf)-1-tot)) > 0)
+    tot += n;
+  close(fd);
+  buf[tot] = 0;
+
+  // Split into lines, dropping fragments, and sort them by
+  // tick. The insertion sort is stable, so lines logged by one
+  // CPU in the same tick keep their order.
+  nline = 0;
+  for(s = buf; *s && nline < MAXLINES; s = p){
+    for(p = s; *p && *p != '\n'; p++)
+      ;
+    if(*p)
+      *p++ = 0;
+    if(tick(s) < 0)
+      continue;
+    for(i = nline; i > 0 && tick(lines[i-1]) > tick(s); i--)
+      lines[i] = lines[i-1];
+    lines[i] = s;
+    nline++;
+  }
+
+  for(j = 0; j < nline; j++)
+    printf("%s\n", lines[j]);
+  exit(0);
+}
@@ -0,0 +1,68 @@
+// Exec latency benchmark: runs ls, echo and cat n times each
+// (default 50) with their output on a pipe, and prints the
+// ticks from fork to the first byte of output and to exit,
+// summed over the runs. The first run of each program records
+// its startup pages; later ones should map them at exec time.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+char *lsargv[] = { "ls", ".", 0 };
+char *echoargv[] = { "echo", "hello", 0 };
+char *catargv[] = { "cat", "README", 0 };
+char **progs[] = { lsargv, echoargv, catargv };
+
+void
+run(char **argv, int n)
+{
+  int i, p[2], pid, t0, first, last;
+  char buf[512];
+
+  first = last = 0;
+  for(i = 0; i < n; i++){
+    if(pipe(p) < 0){
+      printf("execbench: pipe failed\n");
+      exit(1);
+    }
+    t0 = uptime();
+    if((pid = fork()) < 0){
+      printf("execbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(1);
+      dup(p[1]);
+      close(p[0]);
+      close(p[1]);
+      exec(argv[0], argv);
+      exit(1);
+    }
+    close(p[1]);
+    if(read(p[0], buf, sizeof(buf)) <= 0){
+      printf("execbench: %s wrote nothing\n", argv[0]);
+      exit(1);
+    }
+    first += uptime() - t0;
+    while(read(p[0], buf, sizeof(buf)) > 0)
+      ;
+    close(p[0]);
+    wait(0);
+    last += uptime() - t0;
+  }
+  printf("execbench: %s x%d: first output %d ticks, exit %d ticks\n",
+         argv[0], n, first, last);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n;
+
+  n = 50;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  for(i = 0; i < sizeof(progs)/sizeof(progs[0]); i++)
+    run(progs[i], n);
+  exit(0);
+}
@@ -0,0 +1,56 @@
+// Path-lookup microbenchmark: repeatedly resolves a deep path
+// and a missing name, which exercises namex() and the dcache.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define DEPTH 6
+
+char *dirs[DEPTH] = { "lb", "lb/a", "lb/a/b", "lb/a/b/c", "lb/a/b/c/d", "lb/a/b/c/d/e" };
+char *leaf = "lb/a/b/c/d/e/leaf";
+char *missing = "lb/a/b/c/d/e/nosuchfile";
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, fd, t0, t1, t2;
+  struct stat st;
+
+  n = 2000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+
+  for(i = 0; i < DEPTH; i++)
+    mkdir(dirs[i]);
+  if((fd = open(leaf, O_CREATE|O_RDWR)) < 0){
+    printf("lookupbench: cannot create %s\n", leaf);
+    exit(1);
+  }
+  close(fd);
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(stat(leaf, &st) < 0){
+      printf("lookupbench: stat %s failed\n", leaf);
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  for(i = 0; i < n; i++){
+    if(stat(missing, &st) >= 0){
+      printf("lookupbench: %s should not exist\n", missing);
+      exit(1);
+    }
+  }
+  t2 = uptime();
+
+  printf("lookupbench: %d lookups of a %d-deep path: %d ticks\n", n, DEPTH+1, t1 - t0);
+  printf("lookupbench: %d lookups of a missing name: %d ticks\n", n, t2 - t1);
+
+  unlink(leaf);
+  for(i = DEPTH-1; i >= 0; i--)
+    unlink(dirs[i]);
+  exit(0);
+}
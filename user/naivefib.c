@@ -1,5 +1,6 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/vdso.h"
 #include "user/user.h"
 
 int fib(int* tableau, int n){
@@ -21,7 +22,11 @@ main(int argc, char **argv)
   }
   int tableau[800];
   int n = atoi(argv[1]);
+  struct timespec t0, t1;
+  clock_gettime(&t0);
   int res = fib(tableau, n);
-  printf("fib(%d)=%d\n", n, res);
+  clock_gettime(&t1);
+  uint64 us = ((t1.sec - t0.sec) * 1000000000 + t1.nsec - t0.nsec) / 1000;
+  printf("fib(%d)=%d (%d us)\n", n, res, (int)us);
   exit(0);
 }
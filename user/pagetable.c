@@ -1,12 +1,41 @@
+// Print a process's memory areas and page table, as found in
+// /proc/<pid>/maps and /proc/<pid>/pagetable:
+//   pagetable [pid]    (default: this process)
+
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/fcntl.h"
 #include "user/user.h"
 
-int main(){
-    int pid = getpid();
-    printf("Pagetable for PID = %d\n", pid);
-    int ret = dump_pagetable(pid);
-    // printf("pagetable returned %d\n", ret);
-    exit(ret);
+int
+cat(char *pid, char *file)
+{
+  char path[32], buf[512];
+  int fd, n;
+
+  if(strlen(pid) + strlen(file) + 8 > sizeof(path))
+    return -1;
+  strcpy(path, "/proc/");
+  strcpy(path + 6, pid);
+  strcpy(path + 6 + strlen(pid), file);
+  if((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    write(1, buf, n);
+  close(fd);
+  return n;
 }
 
+int
+main(int argc, char *argv[])
+{
+  char *pid = argc > 1 ? argv[1] : "self";
+
+  printf("Memory areas:\n");
+  if(cat(pid, "/maps") < 0){
+    printf("pagetable: no process %s\n", pid);
+    exit(1);
+  }
+  printf("Page table (va pa flags):\n");
+  exit(cat(pid, "/pagetable") < 0);
+}
@@ -0,0 +1,226 @@
+// Profile a command: prof [-r rate] command [args...]
+//
+// Runs the command with the kernel's sampling profiler on,
+// rate samples per tick (default 10), then prints the
+// functions the samples fell in, most frequent first. Kernel
+// pcs are looked up in /sym/kernel.sym, the command's own pcs
+// in /sym/command.sym. Samples taken while other processes,
+// or none, were running are only counted.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define PROF 4     // major number, see kernel/file.h
+#define NTOP 20    // functions to print
+
+struct sym {
+  uint64 addr;
+  char *name;
+  int count;
+};
+
+struct symtab {
+  struct sym *sym;
+  int n;
+};
+
+// Read a symbol file of "address name" lines, as made by the
+// Makefile, sorted by address.
+int
+loadsyms(char *path, struct symtab *t)
+{
+  struct stat st;
+  struct sym tmp;
+  char *buf, *s, *p;
+  int fd, n, gap, i, j, len;
+  uint64 a;
+
+  t->n = 0;
+  if((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  if(fstat(fd, &st) < 0 || (buf = malloc(st.size + 1)) == 0){
+    close(fd);
+    return -1;
+  }
+  n = read(fd, buf, st.size);
+  close(fd);
+  if(n < 0)
+    return -1;
+  buf[n] = 0;
+
+  n = 0;
+  for(s = buf; *s; s++)
+    if(*s == '\n')
+      n++;
+  t->sym = malloc((n + 1) * sizeof(struct sym));
+
+  for(s = buf; *s; s = p){
+    for(p = s; *p && *p != '\n'; p++)
+      ;
+    if(*p)
+      *p++ = 0;
+    a = 0;
+    for(; *s && *s != ' '; s++){
+      if(*s >= '0' && *s <= '9')
+        a = a*16 + *s - '0';
+      else if(*s >= 'a' && *s <= 'f')
+        a = a*16 + *s - 'a' + 10;
+    }
+    // Skip source file names; they share addresses with
+    // the functions.
+    if(*s++ != ' ' || (len = strlen(s)) == 0)
+      continue;
+    if(len > 2 && s[len-2] == '.' && (s[len-1] == 'c' || s[len-1] == 'S'))
+      continue;
+    t->sym[t->n].addr = a;
+    t->sym[t->n].name = s;
+    t->sym[t->n].count = 0;
+    t->n++;
+  }
+
+  for(gap = t->n/2; gap > 0; gap /= 2){
+    for(i = gap; i < t->n; i++){
+      tmp = t->sym[i];
+      for(j = i; j >= gap && t->sym[j-gap].addr > tmp.addr; j -= gap)
+        t->sym[j] = t->sym[j-gap];
+      t->sym[j] = tmp;
+    }
+  }
+  return 0;
+}
+
+// The symbol at or below pc, or 0.
+struct sym*
+lookup(struct symtab *t, uint64 pc)
+{
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = t->n;
+  while(lo < hi){
+    mid = (lo + hi) / 2;
+    if(t->sym[mid].addr <= pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo > 0 ? &t->sym[lo-1] : 0;
+}
+
+// Print the NTOP most sampled symbols of t.
+void
+top(char *what, struct symtab *t, int total)
+{
+  struct sym *best;
+  int i, k;
+
+  for(k = 0; k < NTOP; k++){
+    best = 0;
+    for(i = 0; i < t->n; i++)
+      if(t->sym[i].count > 0 && (best == 0 || t->sym[i].count > best->count))
+        best = &t->sym[i];
+    if(best == 0)
+      break;
+    printf("%d\t%d%%\t%s %s\n", best->count, best->count * 100 / total, what, best->name);
+    best->count = 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct symtab ksyms, usyms;
+  struct profsample *samples;
+  struct sym *sym;
+  char path[64], *name;
+  int fd, rate, pid, n, nbytes, i, cmd, nother, nidle, nunknown;
+
+  rate = 10;
+  cmd = 1;
+  if(argc > 2 && strcmp(argv[1], "-r") == 0){
+    rate = atoi(argv[2]);
+    cmd = 3;
+  }
+  if(cmd >= argc || rate <= 0 || rate > PROFMAXRATE){
+    printf("usage: prof [-r rate] command [args...]\n");
+    exit(1);
+  }
+
+  if((fd = open("prof", O_RDWR)) < 0){
+    mknod("prof", PROF, 0);
+    if((fd = open("prof", O_RDWR)) < 0){
+      printf("prof: cannot open prof\n");
+      exit(1);
+    }
+  }
+
+  if(write(fd, &rate, sizeof(rate)) != sizeof(rate)){
+    printf("prof: cannot start the profiler\n");
+    exit(1);
+  }
+  if((pid = spawn(argv[cmd], argv + cmd, 0, 0)) < 0){
+    printf("prof: cannot run %s\n", argv[cmd]);
+    exit(1);
+  }
+  wait(0);
+  rate = 0;
+  write(fd, &rate, sizeof(rate));
+
+  nbytes = NCPU * NPROFSAMPLE * sizeof(struct profsample);
+  samples = malloc(nbytes);
+  n = 0;
+  while(n < nbytes && (i = read(fd, (char*)samples + n, nbytes - n)) > 0)
+    n += i;
+  close(fd);
+  n /= sizeof(struct profsample);
+
+  // /sym holds the binaries' names, without directories.
+  name = argv[cmd];
+  for(i = strlen(name); i > 0 && name[i-1] != '/'; i--)
+    ;
+  name += i;
+  path[0] = 0;
+  if(strlen(name) + 10 < sizeof(path)){
+    strcpy(path, "/sym/");
+    strcpy(path + 5, name);
+    strcpy(path + 5 + strlen(name), ".sym");
+  }
+  if(loadsyms("/sym/kernel.sym", &ksyms) < 0)
+    printf("prof: no kernel symbols\n");
+  if(loadsyms(path, &usyms) < 0)
+    printf("prof: no symbols for %s\n", name);
+
+  nother = nidle = nunknown = 0;
+  for(i = 0; i < n; i++){
+    if(samples[i].pid == 0){
+      nidle++;
+      continue;
+    }
+    if(samples[i].pid != pid){
+      nother++;
+      continue;
+    }
+    sym = lookup(samples[i].user ? &usyms : &ksyms, samples[i].pc);
+    if(sym)
+      sym->count++;
+    else
+      nunknown++;
+  }
+
+  printf("prof: %d samples\n", n);
+  if(n == 0)
+    exit(0);
+  top("kernel", &ksyms, n);
+  top(name, &usyms, n);
+  if(nother)
+    printf("%d\t%d%%\tother processes\n", nother, nother * 100 / n);
+  if(nidle)
+    printf("%d\t%d%%\tno process\n", nidle, nidle * 100 / n);
+  if(nunknown)
+    printf("%d\t%d%%\tunknown\n", nunknown, nunknown * 100 / n);
+  exit(0);
+}
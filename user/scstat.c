@@ -0,0 +1,132 @@
+// Print system call statistics, top N by total time:
+//   scstat [-n N]                   since boot
+//   scstat [-n N] -p pid            for one process
+//   scstat [-n N] command [args...] while command runs
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "kernel/syscall.h"
+#include "kernel/scstat.h"
+#include "user/user.h"
+
+#define CYCLES_PER_US (MTIME_HZ / 1000000)
+
+char *names[NSYSCALL] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_ntas]    "ntas",
+[SYS_nice]    "nice",
+[SYS_create_mutex]  "create_mutex",
+[SYS_acquire_mutex] "acquire_mutex",
+[SYS_release_mutex] "release_mutex",
+[SYS_dump_pagetable] "dump_pagetable",
+[SYS_fsync]   "fsync",
+[SYS_getdents] "getdents",
+[SYS_spawn]   "spawn",
+[SYS_scstat]  "scstat",
+[SYS_procinfo] "procinfo",
+[SYS_lseek]   "lseek",
+};
+
+struct scstat before[NSYSCALL], after[NSYSCALL];
+
+// Upper bound, in microseconds, of the histogram bucket that
+// holds the q-th percentile call.
+int
+percentile(struct scstat *s, int q)
+{
+  uint64 want, sum;
+  int i;
+
+  want = (s->count * q + 99) / 100;
+  sum = 0;
+  for(i = 0; i < NSCHIST-1; i++){
+    sum += s->hist[i];
+    if(sum >= want)
+      break;
+  }
+  return ((2L << i) + CYCLES_PER_US - 1) / CYCLES_PER_US;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct scstat *s, *best;
+  int i, k, n, pid, cmd;
+  char *name;
+
+  n = 10;
+  pid = 0;
+  cmd = 1;
+  if(cmd + 1 < argc && strcmp(argv[cmd], "-n") == 0){
+    n = atoi(argv[cmd+1]);
+    cmd += 2;
+  }
+  if(cmd + 1 < argc && strcmp(argv[cmd], "-p") == 0){
+    pid = atoi(argv[cmd+1]);
+    cmd += 2;
+  }
+
+  if(pid == 0 && cmd < argc){
+    if(scstat(0, before) < 0){
+      printf("scstat: scstat failed\n");
+      exit(1);
+    }
+    if(spawn(argv[cmd], argv + cmd, 0, 0) < 0){
+      printf("scstat: cannot run %s\n", argv[cmd]);
+      exit(1);
+    }
+    wait(0);
+  }
+  if(scstat(pid, after) < 0){
+    printf("scstat: no process %d\n", pid);
+    exit(1);
+  }
+  for(i = 0; i < NSYSCALL; i++){
+    after[i].count -= before[i].count;
+    after[i].cycles -= before[i].cycles;
+    for(k = 0; k < NSCHIST; k++)
+      after[i].hist[k] -= before[i].hist[k];
+  }
+
+  printf("syscall\t\tcalls\ttotal us\tavg us");
+  printf(pid ? "\n" : "\tp50 us\tp99 us\n");
+  for(k = 0; k < n; k++){
+    best = 0;
+    for(s = after; s < after + NSYSCALL; s++)
+      if(s->count > 0 && (best == 0 || s->cycles > best->cycles))
+        best = s;
+    if(best == 0)
+      break;
+    name = names[best - after] ? names[best - after] : "?";
+    printf("%s\t%s%d\t%d\t\t%d", name, strlen(name) < 8 ? "\t" : "",
+           (int)best->count, (int)(best->cycles / CYCLES_PER_US),
+           (int)(best->cycles / best->count / CYCLES_PER_US));
+    if(pid == 0)
+      printf("\t<%d\t<%d", percentile(best, 50), percentile(best, 99));
+    printf("\n");
+    best->count = 0;
+  }
+  exit(0);
+}
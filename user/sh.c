@@ -3,6 +3,7 @@
 #include "kernel/types.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/spawn.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,6 +53,7 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
 
 // Execute cmd.  Never returns.
 __attribute__((noreturn))
@@ -131,6 +133,95 @@ runcmd(struct cmd *cmd)
   exit(0);
 }
 
+// Can cmd be run by spawncmd() with nact actions already queued?
+// Simple commands with redirections, and pipelines of them, can.
+int
+spawnable(struct cmd *cmd, int nact)
+{
+  struct pipecmd *pcmd;
+
+  if(cmd == 0)
+    return 0;
+  switch(cmd->type){
+  case EXEC:
+    return ((struct execcmd*)cmd)->argv[0] != 0;
+  case REDIR:
+    return nact < NSPAWNACT && spawnable(((struct redircmd*)cmd)->cmd, nact + 1);
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    return nact + 3 <= NSPAWNACT && spawnable(pcmd->left, nact + 3) &&
+           spawnable(pcmd->right, nact + 3);
+  }
+  return 0;
+}
+
+// The processes spawncmd() started, to name the program if
+// its exec fails in the child.
+struct {
+  int pid;
+  char *name;
+} spawned[NSPAWNACT];
+int nspawned;
+
+// Start cmd with spawn(), applying the file actions acts[0..nact)
+// first, without forking a copy of the shell. cmd must be
+// spawnable(). Returns the number of processes started.
+int
+spawncmd(struct cmd *cmd, struct spawnact *acts, int nact)
+{
+  int p[2], n, pid;
+  struct spawnact a[NSPAWNACT];
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  memmove(a, acts, nact * sizeof(a[0]));
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if((pid = spawn(ecmd->argv[0], ecmd->argv, a, nact)) < 0){
+      if(pid != -1 && a[SPAWN_ACTNUM(pid)].op == SPAWN_OPEN)
+        fprintf(2, "open %s failed\n", a[SPAWN_ACTNUM(pid)].path);
+      else
+        fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+      return 0;
+    }
+    if(nspawned < NSPAWNACT){
+      spawned[nspawned].pid = pid;
+      spawned[nspawned++].name = ecmd->argv[0];
+    }
+    return 1;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    a[nact].op = SPAWN_OPEN;
+    a[nact].fd = rcmd->fd;
+    a[nact].omode = rcmd->mode;
+    a[nact].path = rcmd->file;
+    return spawncmd(rcmd->cmd, a, nact + 1);
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    if(pipe(p) < 0)
+      panic("pipe");
+    a[nact].op = SPAWN_DUP2;
+    a[nact].fd = 1;
+    a[nact].fd2 = p[1];
+    a[nact+1].op = SPAWN_CLOSE;
+    a[nact+1].fd = p[0];
+    a[nact+2].op = SPAWN_CLOSE;
+    a[nact+2].fd = p[1];
+    n = spawncmd(pcmd->left, a, nact + 3);
+    a[nact].fd = 0;
+    a[nact].fd2 = p[0];
+    n += spawncmd(pcmd->right, a, nact + 3);
+    close(p[0]);
+    close(p[1]);
+    return n;
+  }
+  return 0;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -147,7 +238,8 @@ int
 main(int argc, char* argv[])
 {
   static char buf[100];
-  int fd;
+  int fd, n, i, pid, status;
+  struct cmd *cmd;
 
   if (argc < 2){
     printf("expected one argument, got argc=%d\n", argc);
@@ -171,9 +263,23 @@ main(int argc, char* argv[])
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait(0);
+    if((cmd = parsecmd(buf)) == 0)
+      continue;
+    if(spawnable(cmd, 0)){
+      // No need to fork a copy of the shell.
+      nspawned = 0;
+      for(n = spawncmd(cmd, 0, 0); n > 0; n--){
+        pid = wait(&status);
+        for(i = 0; i < nspawned; i++)
+          if(spawned[i].pid == pid && status == SPAWN_EXECFAILED)
+            fprintf(2, "exec %s failed\n", spawned[i].name);
+      }
+    } else {
+      if(fork1() == 0)
+        runcmd(cmd);
+      wait(0);
+    }
+    freecmd(cmd);
   }
   exit(0);
 }
@@ -263,18 +369,57 @@ backcmd(struct cmd *subcmd)
   cmd->cmd = subcmd;
   return (struct cmd*)cmd;
 }
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
+
 //PAGEBREAK!
 // Parsing
 
 char whitespace[] = " \t\r\n\v";
 char symbols[] = "<|>&;()";
 
+// Set on a syntax error. The shell parses in the parent, so an
+// error must not exit: from then on the input looks empty, and
+// parsecmd() discards what was built.
+int parseerr;
+
+void
+syntax(char *msg)
+{
+  if(!parseerr)
+    fprintf(2, "%s\n", msg);
+  parseerr = 1;
+}
+
 int
 gettoken(char **ps, char *es, char **q, char **eq)
 {
   char *s;
   int ret;
 
+  if(parseerr)
+    return 0;
   s = *ps;
   while(s < es && strchr(whitespace, *s))
     s++;
@@ -319,6 +464,8 @@ peek(char **ps, char *es, char *toks)
 {
   char *s;
 
+  if(parseerr)
+    return 0;
   s = *ps;
   while(s < es && strchr(whitespace, *s))
     s++;
@@ -340,9 +487,14 @@ parsecmd(char *s)
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parseerr){
     fprintf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(parseerr){
+    parseerr = 0;
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -386,8 +538,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -412,8 +566,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -438,13 +594,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc + 1 >= MAXARGS){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -0,0 +1,73 @@
+// Process creation benchmark: starts "echo" n times (default
+// 100) with fork+exec and with spawn, output to a scratch file,
+// and prints the ticks taken by each.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/spawn.h"
+#include "user/user.h"
+
+char *out = "spawnbench.out";
+char *echoargv[] = { "echo", "x", 0 };
+
+int
+forkexec(int n)
+{
+  int i, t0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("spawnbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(1);
+      if(open(out, O_WRONLY|O_CREATE) != 1)
+        exit(1);
+      exec(echoargv[0], echoargv);
+      exit(1);
+    }
+    wait(0);
+  }
+  return uptime() - t0;
+}
+
+int
+spawnn(int n)
+{
+  int i, t0;
+  struct spawnact act;
+
+  act.op = SPAWN_OPEN;
+  act.fd = 1;
+  act.omode = O_WRONLY|O_CREATE;
+  act.path = out;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(spawn(echoargv[0], echoargv, &act, 1) < 0){
+      printf("spawnbench: spawn failed\n");
+      exit(1);
+    }
+    wait(0);
+  }
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  n = 100;
+  if(argc > 1)
+    n = atoi(argv[1]);
+
+  printf("spawnbench: %d fork+exec: %d ticks\n", n, forkexec(n));
+  printf("spawnbench: %d spawn: %d ticks\n", n, spawnn(n));
+  unlink(out);
+  exit(0);
+}
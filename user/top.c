@@ -0,0 +1,100 @@
+// Show processes by CPU use, refreshed every few ticks:
+//   top [-d ticks] [-n count]
+// -d sets the interval (default 10 ticks), -n the number of
+// screens to show (default 10).
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "kernel/procinfo.h"
+#include "user/user.h"
+
+#define CYCLES_PER_MS (MTIME_HZ / 1000)
+
+char *states[] = { "unused", "sleep", "runble", "run", "zombie" };
+
+struct procinfo prev[NPROC], cur[NPROC];
+int nprev, ncur;
+int cpu[NPROC];   // CPU use over the interval, in tenths of a percent
+
+// The cycles pi has run, minus what it had run at the
+// previous screen.
+uint64
+delta(struct procinfo *pi)
+{
+  int i;
+
+  for(i = 0; i < nprev; i++)
+    if(prev[i].pid == pi->pid)
+      return pi->utime + pi->stime - prev[i].utime - prev[i].stime;
+  return pi->utime + pi->stime;
+}
+
+void
+show(uint64 elapsed)
+{
+  int i, j, k, order[NPROC];
+  struct procinfo *pi;
+
+  for(i = 0; i < ncur; i++){
+    cpu[i] = elapsed ? delta(&cur[i]) * 1000 / elapsed : 0;
+    // Insert i into order[], by decreasing CPU use.
+    for(j = i; j > 0 && cpu[order[j-1]] < cpu[i]; j--)
+      order[j] = order[j-1];
+    order[j] = i;
+  }
+
+  printf("\033[H\033[J");
+  printf("%d processes, uptime %d ticks\n\n", ncur, uptime_fast());
+  printf("PID\tPPID\tSTATE\tCPU%%\tUSR ms\tSYS ms\tRSS\tMINFLT\tMAJFLT\tIN\tOUT\tNAME\n");
+  for(k = 0; k < ncur; k++){
+    i = order[k];
+    pi = &cur[i];
+    printf("%d\t%d\t%s\t%d.%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%s\n",
+           pi->pid, pi->ppid,
+           pi->state >= 0 && pi->state < 5 ? states[pi->state] : "?",
+           cpu[i] / 10, cpu[i] % 10,
+           (int)(pi->utime / CYCLES_PER_MS), (int)(pi->stime / CYCLES_PER_MS),
+           (int)pi->rss, (int)pi->minflt, (int)pi->majflt,
+           (int)pi->inblock, (int)pi->oublock, pi->name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, delay, count;
+  uint64 t, last;
+
+  delay = 10;
+  count = 10;
+  for(i = 1; i + 1 < argc; i += 2){
+    if(strcmp(argv[i], "-d") == 0)
+      delay = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-n") == 0)
+      count = atoi(argv[i+1]);
+    else
+      break;
+  }
+  if(i < argc || delay <= 0){
+    printf("usage: top [-d ticks] [-n count]\n");
+    exit(1);
+  }
+
+  last = rdtime();
+  nprev = procinfo(prev, NPROC);
+  while(count-- > 0){
+    sleep(delay);
+    t = rdtime();
+    if((ncur = procinfo(cur, NPROC)) < 0){
+      printf("top: procinfo failed\n");
+      exit(1);
+    }
+    show(t - last);
+    memmove(prev, cur, sizeof(cur));
+    nprev = ncur;
+    last = t;
+  }
+  exit(0);
+}
@@ -0,0 +1,181 @@
+// Trace a command: trace [-j] command [args...]
+//
+// Runs the command with the kernel's tracepoints on, then
+// prints the records of all CPUs in time order, as text or,
+// with -j, as Chrome trace-event JSON (load it in
+// chrome://tracing or Perfetto after capturing the console).
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define KTRACE 5   // major number, see kernel/file.h
+
+#define CYCLES_PER_US (MTIME_HZ / 1000000)
+
+char *states[] = { "unused", "sleeping", "runnable", "running", "zombie" };
+
+uint64 start;
+
+// Microseconds since the first record.
+int
+us(uint64 t)
+{
+  return (t - start) / CYCLES_PER_US;
+}
+
+char*
+state(uint64 s)
+{
+  return s < sizeof(states)/sizeof(states[0]) ? states[s] : "?";
+}
+
+void
+text(struct tracerec *r)
+{
+  printf("%d\tcpu%d\tpid %d\t", us(r->time), r->cpu, r->pid);
+  switch(r->ev){
+  case TR_RUN:
+    printf("run pid %d\n", (int)r->a);
+    break;
+  case TR_STOP:
+    printf("stop pid %d (%s)\n", (int)r->a, state(r->b));
+    break;
+  case TR_FAULT:
+    printf("page fault at %p, %d us\n", r->a, (int)(r->b / CYCLES_PER_US));
+    break;
+  case TR_BGET:
+    printf("bget block %d %s\n", (int)r->a, r->b ? "hit" : "miss");
+    break;
+  case TR_DISKRW:
+    printf("disk %s block %d\n", r->b ? "write" : "read", (int)r->a);
+    break;
+  case TR_DISKDONE:
+    printf("disk done block %d\n", (int)r->a);
+    break;
+  case TR_COMMIT:
+    printf("log commit of %d blocks, %d us\n", (int)r->a, (int)(r->b / CYCLES_PER_US));
+    break;
+  case TR_LOCK:
+    printf("waited %d us for lock %p\n", (int)(r->b / CYCLES_PER_US), r->a);
+    break;
+  default:
+    printf("event %d %p %p\n", r->ev, r->a, r->b);
+  }
+}
+
+// One trace event; the CPU is the thread, so each CPU gets
+// its own row. Events with a duration start b cycles before
+// they were recorded.
+void
+json(struct tracerec *r, int first)
+{
+  int ts, dur;
+
+  ts = us(r->time);
+  dur = r->b / CYCLES_PER_US;
+  printf(first ? "  " : ", ");
+  switch(r->ev){
+  case TR_RUN:
+    printf("{\"name\":\"pid %d\",\"ph\":\"B\",\"ts\":%d,\"pid\":0,\"tid\":%d}\n",
+           (int)r->a, ts, r->cpu);
+    break;
+  case TR_STOP:
+    printf("{\"name\":\"pid %d\",\"ph\":\"E\",\"ts\":%d,\"pid\":0,\"tid\":%d,\"args\":{\"state\":\"%s\"}}\n",
+           (int)r->a, ts, r->cpu, state(r->b));
+    break;
+  case TR_FAULT:
+  case TR_COMMIT:
+  case TR_LOCK:
+    printf("{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%d,\"dur\":%d,\"pid\":0,\"tid\":%d,\"args\":{\"pid\":%d,\"a\":\"%p\"}}\n",
+           r->ev == TR_FAULT ? "page fault" : r->ev == TR_COMMIT ? "log commit" : "lock wait",
+           ts - dur, dur, r->cpu, r->pid, r->a);
+    break;
+  case TR_BGET:
+    printf("{\"name\":\"bget %s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%d,\"pid\":0,\"tid\":%d,\"args\":{\"block\":%d}}\n",
+           r->b ? "hit" : "miss", ts, r->cpu, (int)r->a);
+    break;
+  case TR_DISKRW:
+  case TR_DISKDONE:
+    printf("{\"name\":\"disk\",\"cat\":\"disk\",\"ph\":\"%s\",\"id\":%d,\"ts\":%d,\"pid\":0,\"tid\":%d,\"args\":{\"block\":%d}}\n",
+           r->ev == TR_DISKRW ? "b" : "e", (int)r->a, ts, r->cpu, (int)r->a);
+    break;
+  default:
+    printf("{\"name\":\"event %d\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%d,\"pid\":0,\"tid\":%d}\n",
+           r->ev, ts, r->cpu);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct tracerec *recs, tmp;
+  int fd, on, jflag, cmd, n, nbytes, gap, i, j;
+
+  jflag = 0;
+  cmd = 1;
+  if(argc > 1 && strcmp(argv[1], "-j") == 0){
+    jflag = 1;
+    cmd = 2;
+  }
+  if(cmd >= argc){
+    printf("usage: trace [-j] command [args...]\n");
+    exit(1);
+  }
+
+  if((fd = open("ktrace", O_RDWR)) < 0){
+    mknod("ktrace", KTRACE, 0);
+    if((fd = open("ktrace", O_RDWR)) < 0){
+      printf("trace: cannot open ktrace\n");
+      exit(1);
+    }
+  }
+
+  on = 1;
+  if(write(fd, &on, sizeof(on)) != sizeof(on)){
+    printf("trace: cannot start tracing\n");
+    exit(1);
+  }
+  if(spawn(argv[cmd], argv + cmd, 0, 0) < 0){
+    printf("trace: cannot run %s\n", argv[cmd]);
+    exit(1);
+  }
+  wait(0);
+  on = 0;
+  write(fd, &on, sizeof(on));
+
+  nbytes = NCPU * NTRACE * sizeof(struct tracerec);
+  recs = malloc(nbytes);
+  n = 0;
+  while(n < nbytes && (i = read(fd, (char*)recs + n, nbytes - n)) > 0)
+    n += i;
+  close(fd);
+  n /= sizeof(struct tracerec);
+
+  // Put the CPUs' records in one timeline.
+  for(gap = n/2; gap > 0; gap /= 2){
+    for(i = gap; i < n; i++){
+      tmp = recs[i];
+      for(j = i; j >= gap && recs[j-gap].time > tmp.time; j -= gap)
+        recs[j] = recs[j-gap];
+      recs[j] = tmp;
+    }
+  }
+  start = n > 0 ? recs[0].time : 0;
+
+  if(jflag)
+    printf("{\"traceEvents\":[\n");
+  for(i = 0; i < n; i++){
+    if(jflag)
+      json(&recs[i], i == 0);
+    else
+      text(&recs[i]);
+  }
+  if(jflag)
+    printf("]}\n");
+  exit(0);
+}
@@ -1,6 +1,9 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/vdso.h"
+#include "kernel/memlayout.h"
+#include "kernel/riscv.h"
 #include "user/user.h"
 
 char*
@@ -144,3 +147,50 @@ int close(int fd){
   }
   return sclose(fd);
 }
+
+// Reading the time without a system call, from the time CSR
+// and the vdso pages (see kernel/vdso.c).
+
+#define vdsotime ((volatile struct vdsotime*)VDSO_TIME)
+#define vdsoproc ((volatile struct vdsoproc*)VDSO_PROC)
+
+uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("csrr %0, time" : "=r" (x) );
+  return x;
+}
+
+// Time since boot.
+int
+clock_gettime(struct timespec *ts)
+{
+  uint64 ns;
+
+  ns = (rdtime() * vdsotime->nsmult) >> vdsotime->nsshift;
+  ts->sec = ns / 1000000000;
+  ts->nsec = ns % 1000000000;
+  return 0;
+}
+
+// Same as uptime().
+int
+uptime_fast(void)
+{
+  return vdsotime->ticks;
+}
+
+int
+getpid_fast(void)
+{
+  return vdsoproc->pid;
+}
+
+// The CPU the caller is running on; it may have moved by the
+// time this returns.
+int
+getcpu(void)
+{
+  return vdsoproc->cpu;
+}
@@ -3,7 +3,12 @@
 #include "kernel/param.h"
 
 struct stat;
+struct dirstat;
+struct spawnact;
 struct rtcdate;
+struct timespec;
+struct scstat;
+struct procinfo;
 
 // system calls
 int fork(void);
@@ -39,6 +44,12 @@ int acquire_mutex(int fd);
 int release_mutex(int fd);
 
 int dump_pagetable(int pid);
+int fsync(int fd);
+int getdents(int fd, struct dirstat *ds, int n);
+int spawn(char *path, char **argv, struct spawnact *acts, int nact);
+int scstat(int pid, struct scstat *st);
+int procinfo(struct procinfo *pi, int n);
+int lseek(int fd, int off, int whence);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -56,6 +67,11 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+uint64 rdtime(void);
+int clock_gettime(struct timespec*);
+int uptime_fast(void);
+int getpid_fast(void);
+int getcpu(void);
 
 void fflush(int fd);
 
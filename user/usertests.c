@@ -4,6 +4,9 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/spawn.h"
+#include "kernel/vdso.h"
+#include "kernel/procinfo.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -180,6 +183,9 @@ writetest(char *s)
 void
 writebig(char *s)
 {
+  // Big enough to need the double-indirect block;
+  // MAXFILE is far larger than the disk.
+  enum { NBIG = NDIRECT + NINDIRECT + 20 };
   int i, fd, n;
 
   fd = open("big", O_CREATE|O_RDWR);
@@ -188,7 +194,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < NBIG; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -208,7 +214,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != NBIG){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -1124,6 +1130,580 @@ bigdir(char *s)
   }
 }
 
+// program text is mapped read-only; data pages are shared
+// copy-on-write after fork, so writes stay private.
+int cowdata = 1;
+
+void
+textshare(char *s)
+{
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *(volatile char*)textshare = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: wrote to program text\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    cowdata = 2;
+    exit(cowdata == 2 ? 0 : 1);
+  }
+  cowdata = 3;
+  wait(&xstatus);
+  if(xstatus != 0 || cowdata != 3){
+    printf("%s: data page not private after fork\n", s);
+    exit(1);
+  }
+}
+
+// spawn runs a program in a new child with file actions
+// applied to a copy of our descriptors, leaving ours alone.
+void
+spawntest(char *s)
+{
+  struct spawnact act[2];
+  char *args[] = { "echo", "spawned", 0 };
+  char buf[16];
+  int fd, xstatus, n;
+
+  unlink("spawn.out");
+  act[0].op = SPAWN_OPEN;
+  act[0].fd = 1;
+  act[0].omode = O_WRONLY|O_CREATE;
+  act[0].path = "spawn.out";
+  act[1].op = SPAWN_CLOSE;
+  act[1].fd = 0;
+  if(spawn("echo", args, act, 2) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: spawned echo failed\n", s);
+    exit(1);
+  }
+  fd = open("spawn.out", O_RDONLY);
+  n = read(fd, buf, sizeof(buf));
+  close(fd);
+  if(n != 8 || memcmp(buf, "spawned\n", 8) != 0){
+    printf("%s: wrong output from spawned echo\n", s);
+    exit(1);
+  }
+  unlink("spawn.out");
+
+  act[0].path = "nosuchdir/x";
+  if(spawn("echo", args, act, 1) != SPAWN_EACT(0)){
+    printf("%s: spawn with a bad action did not fail in it\n", s);
+    exit(1);
+  }
+  if(spawn("nosuchprogram", args, 0, 0) != -1 || spawn("README", args, 0, 0) != -1){
+    printf("%s: spawn of a non-program did not fail\n", s);
+    exit(1);
+  }
+}
+
+// The vdso pages agree with the system calls, the clock
+// moves forward, and user code cannot write the pages.
+void
+vdsotest(char *s)
+{
+  struct timespec t0, t1;
+  int pid, xstatus, t;
+
+  if(getpid_fast() != getpid()){
+    printf("%s: vdso pid %d, getpid %d\n", s, getpid_fast(), getpid());
+    exit(1);
+  }
+  t = uptime();
+  if(uptime_fast() < t - 1 || uptime_fast() > t + 1){
+    printf("%s: vdso ticks %d, uptime %d\n", s, uptime_fast(), t);
+    exit(1);
+  }
+  if(getcpu() < 0 || getcpu() >= NCPU){
+    printf("%s: bad cpu %d\n", s, getcpu());
+    exit(1);
+  }
+
+  clock_gettime(&t0);
+  sleep(2);
+  clock_gettime(&t1);
+  if(t1.sec*1000000000 + t1.nsec <= t0.sec*1000000000 + t0.nsec){
+    printf("%s: clock did not move\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(getpid_fast() != getpid())
+      exit(1);
+    *(volatile int*)VDSO_TIME = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: child wrote to the vdso page or had the wrong pid\n", s);
+    exit(1);
+  }
+}
+
+// Find our own entry in procinfo's output.
+int
+myinfo(struct procinfo *me)
+{
+  static struct procinfo pi[NPROC];
+  int i, n;
+
+  n = procinfo(pi, NPROC);
+  for(i = 0; i < n; i++){
+    if(pi[i].pid == getpid()){
+      *me = pi[i];
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// procinfo counts the pages we touch and the time we run.
+void
+rusagetest(char *s)
+{
+  struct procinfo before, after;
+  volatile char *p;
+  volatile int j;
+  int i;
+
+  if(myinfo(&before) < 0){
+    printf("%s: not in procinfo\n", s);
+    exit(1);
+  }
+  p = sbrk(10*PGSIZE);
+  for(i = 0; i < 10; i++)
+    p[i*PGSIZE] = 1;
+  for(j = 0; j < 10000000; j++)
+    ;
+  if(myinfo(&after) < 0){
+    printf("%s: not in procinfo\n", s);
+    exit(1);
+  }
+  if(after.rss < before.rss + 10 || after.minflt < before.minflt + 10){
+    printf("%s: rss %d -> %d, minflt %d -> %d\n", s,
+           (int)before.rss, (int)after.rss, (int)before.minflt, (int)after.minflt);
+    exit(1);
+  }
+  if(after.utime <= before.utime || after.stime <= before.stime){
+    printf("%s: cpu time did not grow\n", s);
+    exit(1);
+  }
+  sbrk(-10*PGSIZE);
+}
+
+// Read all of a /proc file into buf; returns its length.
+int
+readproc(char *s, char *path, char *buf, int n)
+{
+  int fd, m, len;
+
+  if((fd = open(path, O_RDONLY)) < 0){
+    printf("%s: cannot open %s\n", s, path);
+    exit(1);
+  }
+  len = 0;
+  while(len < n - 1 && (m = read(fd, buf + len, n - 1 - len)) > 0)
+    len += m;
+  close(fd);
+  buf[len] = 0;
+  return len;
+}
+
+// /proc lists this process and generates its files' text
+// when they are read; it cannot be written.
+void
+procfstest(char *s)
+{
+  static char buf[4096];
+  struct dirstat ds[8];
+  struct stat st;
+  int fd, i, n, found;
+
+  if(readproc(s, "/proc/meminfo", buf, sizeof(buf)) == 0 ||
+     memcmp(buf, "MemTotal:", 9) != 0){
+    printf("%s: bad meminfo: %s\n", s, buf);
+    exit(1);
+  }
+  readproc(s, "/proc/self/maps", buf, sizeof(buf));
+  for(i = 0; buf[i] && memcmp(buf + i, "[stack]", 7) != 0; i++)
+    ;
+  if(buf[i] == 0){
+    printf("%s: no stack in maps: %s\n", s, buf);
+    exit(1);
+  }
+  if(readproc(s, "/proc/self/pagetable", buf, sizeof(buf)) == 0){
+    printf("%s: empty pagetable\n", s);
+    exit(1);
+  }
+
+  found = 0;
+  fd = open("/proc", O_RDONLY);
+  while((n = getdents(fd, ds, 8)) > 0)
+    for(i = 0; i < n; i++)
+      if(ds[i].type == T_DIR && atoi(ds[i].name) == getpid())
+        found = 1;
+  close(fd);
+  if(n < 0 || !found){
+    printf("%s: /proc does not list pid %d\n", s, getpid());
+    exit(1);
+  }
+
+  if(open("/proc/meminfo", O_RDWR) >= 0 || open("/proc/nosuch", O_RDONLY) >= 0 ||
+     open("/proc/self/nosuch", O_RDONLY) >= 0){
+    printf("%s: opened what is not there\n", s);
+    exit(1);
+  }
+
+  // Relative paths from inside /proc.
+  if(chdir("/proc") < 0){
+    printf("%s: chdir /proc failed\n", s);
+    exit(1);
+  }
+  if(readproc(s, "meminfo", buf, sizeof(buf)) == 0 ||
+     memcmp(buf, "MemTotal:", 9) != 0){
+    printf("%s: bad relative meminfo: %s\n", s, buf);
+    exit(1);
+  }
+  fd = open(".", O_RDONLY);
+  n = getdents(fd, ds, 8);
+  close(fd);
+  if(n <= 0 || strcmp(ds[0].name, "meminfo") != 0){
+    printf("%s: . in /proc is not /proc\n", s);
+    exit(1);
+  }
+  if(chdir("..") < 0 || stat(".", &st) < 0 || st.ino != ROOTINO){
+    printf("%s: .. from /proc is not /\n", s);
+    exit(1);
+  }
+}
+
+// Two processes regenerate the text of one shared /proc fd
+// at once.
+void
+procfssharedtest(char *s)
+{
+  char buf[64];
+  int fd, i, pid, xstatus;
+
+  if((fd = open("/proc/self/pagetable", O_RDONLY)) < 0){
+    printf("%s: open /proc/self/pagetable failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 200; i++){
+    if(lseek(fd, 0, SEEK_SET) != 0 || read(fd, buf, sizeof(buf)) <= 0){
+      printf("%s: read of shared /proc fd failed\n", s);
+      exit(1);
+    }
+  }
+  if(pid == 0)
+    exit(0);
+  wait(&xstatus);
+  close(fd);
+  if(xstatus != 0)
+    exit(xstatus);
+}
+
+// lseek moves the offset within a file, but not past its end.
+void
+lseektest(char *s)
+{
+  char buf[10];
+  int fd;
+
+  fd = open("lseek.tmp", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "0123456789", 10) != 10){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 3, SEEK_SET) != 3 || read(fd, buf, 2) != 2 || memcmp(buf, "34", 2) != 0 ||
+     lseek(fd, 2, SEEK_CUR) != 7 || read(fd, buf, 10) != 3 || memcmp(buf, "789", 3) != 0){
+    printf("%s: seek and read failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, -2, SEEK_END) != 8 || write(fd, "xy", 2) != 2 ||
+     lseek(fd, 0, SEEK_SET) != 0 || read(fd, buf, 10) != 10 || memcmp(buf, "01234567xy", 10) != 0){
+    printf("%s: seek and write failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 1, SEEK_END) >= 0 || lseek(fd, -1, SEEK_SET) >= 0){
+    printf("%s: seeked past the ends\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("lseek.tmp");
+}
+
+// getdents returns every entry of a directory, in batches,
+// with its inode's type and size.
+void
+getdentstest(char *s)
+{
+  enum { N = 20 };
+  struct dirstat ds[7];
+  int fd, i, n, tot, files;
+  char name[3];
+
+  if(mkdir("gd") != 0 || chdir("gd") != 0){
+    printf("%s: getdents mkdir failed\n", s);
+    exit(1);
+  }
+  name[0] = 'g';
+  name[2] = '\0';
+  for(i = 0; i < N; i++){
+    name[1] = 'a' + i;
+    fd = open(name, O_CREATE|O_RDWR);
+    if(fd < 0 || write(fd, "0123456789", i % 10) != i % 10){
+      printf("%s: getdents create failed\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  fd = open(".", O_RDONLY);
+  tot = files = 0;
+  while((n = getdents(fd, ds, 7)) > 0){
+    for(i = 0; i < n; i++){
+      tot++;
+      if(ds[i].name[0] != 'g')
+        continue;
+      files++;
+      if(ds[i].type != T_FILE || ds[i].size != (ds[i].name[1] - 'a') % 10){
+        printf("%s: getdents %s: type %d size %d\n", s, ds[i].name, ds[i].type, (int)ds[i].size);
+        exit(1);
+      }
+    }
+  }
+  close(fd);
+  if(n < 0 || tot != N + 2 || files != N){
+    printf("%s: getdents returned %d entries\n", s, tot);
+    exit(1);
+  }
+
+  for(i = 0; i < N; i++){
+    name[1] = 'a' + i;
+    unlink(name);
+  }
+  if(chdir("..") != 0 || unlink("gd") != 0){
+    printf("%s: getdents rmdir failed\n", s);
+    exit(1);
+  }
+}
+
+// small appends are buffered in the kernel; they must be
+// visible to readers, fstat and later overwrites before and
+// after fsync.
+void
+delaywrite(char *s)
+{
+  enum { N = 40, SZ = 100 };
+  int i, fd, fd2;
+  char b[SZ];
+  struct stat st;
+
+  unlink("dw");
+  fd = open("dw", O_CREATE|O_RDWR);
+  fd2 = open("dw", O_RDONLY);
+  if(fd < 0 || fd2 < 0){
+    printf("%s: delaywrite open failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(b, 'a' + i % 26, SZ);
+    if(write(fd, b, SZ) != SZ){
+      printf("%s: delaywrite write failed\n", s);
+      exit(1);
+    }
+    if(read(fd2, b, SZ) != SZ || b[0] != 'a' + i % 26 || b[SZ-1] != 'a' + i % 26){
+      printf("%s: delaywrite read %d wrong\n", s, i);
+      exit(1);
+    }
+  }
+  if(fstat(fd, &st) < 0 || st.size != N*SZ){
+    printf("%s: delaywrite size %d\n", s, (int)st.size);
+    exit(1);
+  }
+  if(fsync(fd) < 0){
+    printf("%s: fsync failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fd2);
+
+  // buffer one more append, then overwrite the start of
+  // the file through another descriptor.
+  fd = open("dw", O_RDWR);
+  for(i = 0; i < N; i++)
+    read(fd, b, SZ);
+  memset(b, 'y', SZ);
+  fd2 = open("dw", O_RDWR);
+  if(write(fd, b, SZ) != SZ){
+    printf("%s: delaywrite append failed\n", s);
+    exit(1);
+  }
+  memset(b, 'Z', SZ);
+  if(write(fd2, b, SZ) != SZ){
+    printf("%s: delaywrite overwrite failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fd2);
+  fd = open("dw", O_RDONLY);
+  for(i = 0; i <= N; i++){
+    if(read(fd, b, SZ) != SZ ||
+       b[0] != (i == 0 ? 'Z' : i == N ? 'y' : 'a' + i % 26)){
+      printf("%s: delaywrite reread %d wrong\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("dw");
+}
+
+// small appends to a file that is unlinked but still open
+// must not be discarded when its write buffer is flushed.
+void
+unlinkedwrite(char *s)
+{
+  enum { N = 100, SZ = 100 };
+  int i, fd, rfd;
+  char b[SZ];
+
+  fd = open("uw", O_CREATE|O_RDWR);
+  rfd = open("uw", O_RDONLY);
+  if(fd < 0 || rfd < 0 || unlink("uw") != 0){
+    printf("%s: unlinkedwrite create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(b, 'a' + i % 26, SZ);
+    if(write(fd, b, SZ) != SZ){
+      printf("%s: unlinkedwrite write %d failed\n", s, i);
+      exit(1);
+    }
+    if(i == N/2)
+      fsync(fd);
+  }
+  for(i = 0; i < N; i++){
+    if(read(rfd, b, SZ) != SZ || b[0] != 'a' + i % 26 || b[SZ-1] != 'a' + i % 26){
+      printf("%s: unlinkedwrite reread %d wrong\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  close(rfd);
+}
+
+// a subdirectory big enough to be converted to the hashed
+// format: every name must be found, enumerable with read(),
+// and removable, and the emptied directory must be removable.
+void
+hashdir(char *s)
+{
+  enum { N = 300 };
+  int i, fd, n;
+  char name[8];
+  struct dirent de;
+  struct stat st;
+
+  if(mkdir("hd") != 0 || chdir("hd") != 0){
+    printf("%s: hashdir mkdir failed\n", s);
+    exit(1);
+  }
+  fd = open("f", O_CREATE);
+  if(fd < 0){
+    printf("%s: hashdir create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  name[0] = 'h';
+  name[4] = '\0';
+  for(i = 0; i < N; i++){
+    name[1] = '0' + i / 100;
+    name[2] = '0' + (i / 10) % 10;
+    name[3] = '0' + i % 10;
+    if(link("f", name) != 0){
+      printf("%s: hashdir link %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  for(i = 0; i < N; i += 2){
+    name[1] = '0' + i / 100;
+    name[2] = '0' + (i / 10) % 10;
+    name[3] = '0' + i % 10;
+    if(unlink(name) != 0){
+      printf("%s: hashdir unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  for(i = 0; i < N; i++){
+    name[1] = '0' + i / 100;
+    name[2] = '0' + (i / 10) % 10;
+    name[3] = '0' + i % 10;
+    if((stat(name, &st) == 0) != (i % 2 == 1)){
+      printf("%s: hashdir stat %s wrong\n", s, name);
+      exit(1);
+    }
+  }
+
+  // ".", "..", "f" and the odd names.
+  fd = open(".", 0);
+  n = 0;
+  while(read(fd, &de, sizeof(de)) == sizeof(de))
+    if(de.inum != 0)
+      n++;
+  close(fd);
+  if(n != N/2 + 3){
+    printf("%s: hashdir read %d entries\n", s, n);
+    exit(1);
+  }
+
+  for(i = 1; i < N; i += 2){
+    name[1] = '0' + i / 100;
+    name[2] = '0' + (i / 10) % 10;
+    name[3] = '0' + i % 10;
+    if(unlink(name) != 0){
+      printf("%s: hashdir unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  unlink("f");
+  if(chdir("..") != 0 || unlink("hd") != 0){
+    printf("%s: hashdir rmdir failed\n", s);
+    exit(1);
+  }
+}
+
 void
 subdir(char *s)
 {
@@ -2179,6 +2759,17 @@ main(int argc, char *argv[])
     {iref, "iref", 0},
     {forktest, "forktest", 0},
     {bigdir, "bigdir", 0}, // slow
+    {hashdir, "hashdir", 0},
+    {delaywrite, "delaywrite", 0},
+    {unlinkedwrite, "unlinkedwrite", 0},
+    {getdentstest, "getdents", 0},
+    {textshare, "textshare", 0},
+    {spawntest, "spawn", 0},
+    {vdsotest, "vdso", 0},
+    {rusagetest, "rusage", 0},
+    {procfstest, "procfs", 0},
+    {procfssharedtest, "procfsshared", 0},
+    {lseektest, "lseek", 0},
     { 0, 0, 0},
   };
     
@@ -52,3 +52,9 @@ entry("create_mutex");
 entry("acquire_mutex");
 entry("release_mutex");
 entry("dump_pagetable");
+entry("fsync");
+entry("getdents");
+entry("spawn");
+entry("scstat");
+entry("procinfo");
+entry("lseek");